@@ -0,0 +1,390 @@
+// Runs a server on the loopback interface against a swarm of clients in a
+// second thread and reports the CPU time the server thread spends per tick,
+// for comparing the socket backends of Network. Every client joins as a
+// player and reads everything the server sends, some of them turn each
+// tick. The swarm does not look at what it reads, so real clients that
+// simulate the game join as well, see SyncClient.h. The benchmark fails if
+// any of them saw its state differ from the server.
+//
+//   NetworkBenchmark [--clients N] [--ticks N] [--turns N] [--port N]
+//                    [--width N] [--height N] [--backend sockets|ring]
+//                    [--net-threads N] [--sync-clients N]
+//
+// With network threads only the game thread is measured, the time they
+// spend on the sockets is not included.
+//
+// Linux only, the swarm uses epoll directly. Each client takes two file
+// descriptors, the limit is raised as far as the system allows.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Game.h"
+#include "Logging.h"
+#include "Network.h"
+#include "Players.h"
+#include "SyncClient.h"
+#include "Utils.h"
+
+struct BenchConfig_t
+{
+    ArenaConfig_t arena;
+    uint32_t clients = 1000;
+    uint32_t ticks = 200;
+    uint32_t turns = 50;
+    uint16_t port = 11755;
+    uint32_t netThreads = 0;
+    uint32_t syncClients = 1;
+    NetworkBackend backend = NetworkBackend::SOCKETS;
+};
+
+struct SwarmResult_t
+{
+    std::atomic<uint32_t> connected{ 0 };
+    std::atomic<uint64_t> bytesReceived{ 0 };
+    std::atomic<bool> failed{ false };
+};
+
+static std::atomic<bool> _stopSwarm{ false };
+
+static uint64_t threadCpuNs()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+static void runSwarm(const BenchConfig_t& config, SwarmResult_t& result)
+{
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    MessageClientHello msgHello{};
+    msgHello.version = NETWORK_VERSION;
+    snprintf(msgHello.name, sizeof(msgHello.name), "Swarm");
+
+    Buffer hello;
+    Network::writeMessage(msgHello, hello);
+
+    const int epoll = epoll_create1(EPOLL_CLOEXEC);
+    std::vector<int> sockets;
+    for (uint32_t i = 0; i < config.clients; i++)
+    {
+        const int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (sock == -1
+            || connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))
+                   != 0)
+        {
+            printf("ERROR: Client %u failed to connect: %d\n", i, errno);
+            result.failed = true;
+            break;
+        }
+
+        const int one = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+        send(sock, hello.base(), hello.size(), MSG_NOSIGNAL);
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u32 = static_cast<uint32_t>(sockets.size());
+        epoll_ctl(epoll, EPOLL_CTL_ADD, sock, &ev);
+
+        sockets.push_back(sock);
+        result.connected++;
+    }
+
+    static constexpr Vector2i DIRECTIONS[] = {
+        DIR_UP,
+        DIR_RIGHT,
+        DIR_DOWN,
+        DIR_LEFT,
+    };
+
+    std::vector<epoll_event> events(1024);
+    std::vector<uint8_t> data(64 * 1024);
+    uint32_t rand = 1;
+    double nextTurns = Utils::getTime();
+
+    while (!_stopSwarm && !sockets.empty())
+    {
+        const int count = epoll_wait(
+            epoll, events.data(), static_cast<int>(events.size()), 1);
+        for (int i = 0; i < count; i++)
+        {
+            const int sock = sockets[events[i].data.u32];
+            while (true)
+            {
+                const ssize_t res = recv(sock, data.data(), data.size(), 0);
+                if (res <= 0)
+                    break;
+                result.bytesReceived += static_cast<uint64_t>(res);
+            }
+        }
+
+        if (Utils::getTime() < nextTurns)
+            continue;
+        nextTurns += GAME_TICK_RATE;
+
+        for (uint32_t i = 0; i < config.turns; i++)
+        {
+            rand ^= rand << 13;
+            rand ^= rand >> 17;
+            rand ^= rand << 5;
+
+            // Meant for a tick long gone, the server applies it right away.
+            MessageClientSnakeDirection msgDirection;
+            msgDirection.tick = 0;
+            msgDirection.sequence = i;
+            msgDirection.newDirection = DIRECTIONS[rand % 4];
+
+            Buffer buffer;
+            Network::writeMessage(msgDirection, buffer);
+            send(
+                sockets[(rand >> 2) % sockets.size()], buffer.base(),
+                buffer.size(), MSG_NOSIGNAL);
+        }
+    }
+
+    for (int sock : sockets)
+    {
+        close(sock);
+    }
+    close(epoll);
+}
+
+// Runs the server loop of the dedicated server until the given tick.
+static void runServer(uint32_t endTick, std::vector<uint64_t>* tickCpuNs)
+{
+    double nextTick = Utils::getTime() + GAME_TICK_RATE;
+    uint64_t tickStart = threadCpuNs();
+
+    while (gGame.getTick() < endTick)
+    {
+        const double now = Utils::getTime();
+        if (now < nextTick)
+        {
+            const int32_t timeoutMs = static_cast<int32_t>(
+                (nextTick - now) * 1000.0 + 1.0);
+            gNetwork.wait(timeoutMs);
+            gNetwork.update();
+            gNetwork.flush();
+            continue;
+        }
+
+        gGame.update();
+        nextTick += GAME_TICK_RATE;
+        if (nextTick < now)
+            nextTick = now + GAME_TICK_RATE;
+
+        if (tickCpuNs != nullptr)
+        {
+            const uint64_t tickEnd = threadCpuNs();
+            tickCpuNs->push_back(tickEnd - tickStart);
+            tickStart = tickEnd;
+        }
+    }
+}
+
+static uint64_t percentile(const std::vector<uint64_t>& sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+
+    const size_t index = static_cast<size_t>(p * (sorted.size() - 1));
+    return sorted[index];
+}
+
+static bool parseArgs(int argc, char** argv, BenchConfig_t& config)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            printf("ERROR: Missing value for %s\n", arg);
+            return false;
+        }
+
+        const char* value = argv[++i];
+        if (strcmp(arg, "--clients") == 0)
+            config.clients = static_cast<uint32_t>(atol(value));
+        else if (strcmp(arg, "--ticks") == 0)
+            config.ticks = static_cast<uint32_t>(atol(value));
+        else if (strcmp(arg, "--turns") == 0)
+            config.turns = static_cast<uint32_t>(atol(value));
+        else if (strcmp(arg, "--port") == 0)
+            config.port = static_cast<uint16_t>(atol(value));
+        else if (strcmp(arg, "--width") == 0)
+            config.arena.width = atoi(value);
+        else if (strcmp(arg, "--height") == 0)
+            config.arena.height = atoi(value);
+        else if (strcmp(arg, "--backend") == 0 && strcmp(value, "ring") == 0)
+            config.backend = NetworkBackend::RING;
+        else if (strcmp(arg, "--backend") == 0
+                 && strcmp(value, "sockets") == 0)
+            config.backend = NetworkBackend::SOCKETS;
+        else if (strcmp(arg, "--net-threads") == 0)
+            config.netThreads = static_cast<uint32_t>(atol(value));
+        else if (strcmp(arg, "--sync-clients") == 0)
+            config.syncClients = static_cast<uint32_t>(atol(value));
+        else
+        {
+            printf("ERROR: Unknown option %s\n", arg);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    BenchConfig_t config;
+    config.arena.width = 1024;
+    config.arena.height = 1024;
+
+    if (!parseArgs(argc, argv, config))
+        return EXIT_FAILURE;
+
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    // Every join is logged, keep the output to the results.
+    gLogging.setEnabled(false);
+
+    const uint32_t players = config.clients + config.syncClients;
+    config.arena.maxPlayers = players;
+    if (!gGame.setArena(config.arena))
+    {
+        printf(
+            "ERROR: Invalid arena: %d x %d, %u clients\n", config.arena.width,
+            config.arena.height, players);
+        return EXIT_FAILURE;
+    }
+
+    // The sync clients are forked before anything of the server exists.
+    std::vector<std::unique_ptr<SyncClient>> syncClients;
+    for (uint32_t i = 0; i < config.syncClients; i++)
+    {
+        auto client = std::make_unique<SyncClient>();
+        if (!client->fork(config.port, NetworkTransport::TCP, GAME_TICK_RATE))
+        {
+            printf("ERROR: Unable to start sync client %u\n", i);
+            return EXIT_FAILURE;
+        }
+        syncClients.push_back(std::move(client));
+    }
+
+    gNetwork.startServer(
+        "127.0.0.1", config.port, config.backend, config.netThreads);
+    gGame.init(nullptr);
+
+    const char* backendName = gNetwork.getBackend() == NetworkBackend::RING
+                                  ? "ring"
+                                  : "sockets";
+    printf(
+        "backend %s, %u network threads, %u clients, %u sync clients, %u "
+        "ticks, %u turns per tick\n",
+        backendName, config.netThreads, config.clients, config.syncClients,
+        config.ticks, config.turns);
+
+    for (auto& client : syncClients)
+    {
+        client->start();
+    }
+
+    SwarmResult_t swarm;
+    std::thread swarmThread(runSwarm, std::cref(config), std::ref(swarm));
+
+    // Everyone joins before the measurement starts.
+    while (gPlayers.count() < players && !swarm.failed)
+    {
+        runServer(gGame.getTick() + 1, nullptr);
+    }
+
+    std::vector<uint64_t> tickCpuNs;
+    tickCpuNs.reserve(config.ticks);
+
+    const uint64_t bytesStart = swarm.bytesReceived;
+    runServer(gGame.getTick() + config.ticks, &tickCpuNs);
+    const uint64_t bytes = swarm.bytesReceived - bytesStart;
+
+    _stopSwarm = true;
+    swarmThread.join();
+
+    // The sync clients stop once their control socket closes.
+    if (swarm.failed)
+        return EXIT_FAILURE;
+
+    uint64_t totalNs = 0;
+    for (uint64_t ns : tickCpuNs)
+    {
+        totalNs += ns;
+    }
+    std::sort(tickCpuNs.begin(), tickCpuNs.end());
+
+    printf(
+        "%-8s %10s %10s %10s %10s %14s\n", "backend", "avg us", "p50 us",
+        "p99 us", "max us", "KB/tick recv");
+    printf(
+        "%-8s %10.1f %10.1f %10.1f %10.1f %14.1f\n", backendName,
+        tickCpuNs.empty() ? 0.0 : totalNs / 1000.0 / tickCpuNs.size(),
+        percentile(tickCpuNs, 0.5) / 1000.0,
+        percentile(tickCpuNs, 0.99) / 1000.0,
+        tickCpuNs.empty() ? 0.0 : tickCpuNs.back() / 1000.0,
+        tickCpuNs.empty() ? 0.0 : bytes / 1024.0 / tickCpuNs.size());
+
+    bool failed = false;
+    if (!syncClients.empty())
+    {
+        printf(
+            "%-8s %10s %10s %10s\n", "sync", "tick", "desyncs", "desynced");
+    }
+    for (size_t i = 0; i < syncClients.size(); i++)
+    {
+        SyncResult_t result;
+        if (!syncClients[i]->finish(result))
+        {
+            printf("ERROR: Sync client %zu did not report\n", i);
+            failed = true;
+            continue;
+        }
+
+        printf(
+            "%-8zu %10u %10u %10s\n", i, result.tick, result.desyncs,
+            result.desynced ? "yes" : "no");
+
+        if (!result.joined || result.desyncs > 0 || result.desynced)
+            failed = true;
+    }
+
+    if (failed)
+    {
+        printf("ERROR: Sync clients did not stay in sync\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,390 @@
+// Runs a server taking clients over UDP on the loopback interface against
+// clients in a second thread that drop a share of the datagrams in both
+// directions. Reports how long after the start of each tick its frame
+// reached the clients, and fails if a frame was lost or came out of order.
+//
+//   NetworkLossBenchmark [--clients N] [--ticks N] [--loss PERCENT]
+//                        [--bots N] [--port N] [--width N] [--height N]
+//
+// Linux only, like NetworkBenchmark.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Bots.h"
+#include "Game.h"
+#include "Logging.h"
+#include "Network.h"
+#include "Utils.h"
+
+// Start times of the last ticks, by tick.
+static constexpr uint32_t TICK_HISTORY = 1024;
+
+struct BenchConfig_t
+{
+    ArenaConfig_t arena;
+    uint32_t clients = 16;
+    uint32_t ticks = 400;
+    uint32_t bots = 16;
+    double loss = 5.0;
+    uint16_t port = 11756;
+};
+
+struct LossClient_t
+{
+    std::unique_ptr<IUdpSocket> sock;
+    std::unique_ptr<UdpChannel> channel;
+    RecvBuffer_t recv;
+
+    // Last frame received, 0 before the first one.
+    uint32_t tick = 0;
+};
+
+struct ClientsResult_t
+{
+    std::atomic<uint32_t> joined{ 0 };
+    std::atomic<bool> failed{ false };
+
+    // Only touched by the client thread until it was joined.
+    std::vector<double> latencies;
+    uint64_t datagrams = 0;
+    uint64_t dropped = 0;
+    uint32_t outOfOrder = 0;
+};
+
+static std::atomic<double> _tickStart[TICK_HISTORY];
+static std::atomic<bool> _measure{ false };
+static std::atomic<bool> _stopClients{ false };
+
+class LossFilter
+{
+    uint32_t _rand = 1;
+    uint32_t _threshold;
+
+public:
+    explicit LossFilter(double percent)
+        : _threshold(static_cast<uint32_t>(percent / 100.0 * 65536.0))
+    {
+    }
+
+    bool drop()
+    {
+        _rand ^= _rand << 13;
+        _rand ^= _rand >> 17;
+        _rand ^= _rand << 5;
+        return (_rand & 0xFFFF) < _threshold;
+    }
+};
+
+// Reads the frames out of everything received in order.
+static void processStream(LossClient_t& client, ClientsResult_t& result)
+{
+    auto& recv = client.recv;
+    while (true)
+    {
+        Network::reserveRecvSpace(recv);
+
+        const size_t space = recv.data.size() - recv.size;
+        const size_t received = client.channel->read(
+            recv.data.data() + recv.size, space);
+
+        recv.size += received;
+        if (received < space)
+            break;
+    }
+
+    while (recv.size - recv.readPos >= sizeof(MessageHeader_t))
+    {
+        uint8_t* message = recv.data.data() + recv.readPos;
+
+        MessageHeader_t header;
+        memcpy(&header, message, sizeof(header));
+        if (sizeof(header) + header.size > recv.size - recv.readPos)
+            break;
+        recv.readPos += sizeof(header) + header.size;
+
+        if (header.msg != NetworkMessage::SERVER_FRAME)
+            continue;
+
+        MessageServerFrame msgFrame;
+        Buffer buffer(message + sizeof(header), header.size);
+        if (!msgFrame.deserialize(buffer))
+        {
+            result.failed = true;
+            continue;
+        }
+
+        if (client.tick == 0)
+            result.joined++;
+        else if (msgFrame.tick != client.tick + 1)
+            result.outOfOrder++;
+        client.tick = msgFrame.tick;
+
+        if (_measure)
+        {
+            const double start = _tickStart[msgFrame.tick % TICK_HISTORY];
+            result.latencies.push_back(Utils::getTime() - start);
+        }
+    }
+
+    if (recv.readPos == recv.size)
+    {
+        recv.readPos = 0;
+        recv.size = 0;
+    }
+}
+
+static void runClients(const BenchConfig_t& config, ClientsResult_t& result)
+{
+    MessageClientHello msgHello{};
+    msgHello.version = NETWORK_VERSION;
+    snprintf(msgHello.name, sizeof(msgHello.name), "Lossy");
+
+    Buffer hello;
+    Network::writeMessage(msgHello, hello);
+
+    auto poller = CreateSocketPoller();
+
+    std::vector<LossClient_t> clients(config.clients);
+    for (auto& client : clients)
+    {
+        client.sock = CreateUdpSocket();
+        if (!client.sock->Connect("127.0.0.1", config.port)
+            || !poller->Add(client.sock.get(), &client))
+        {
+            printf("ERROR: Client failed to connect\n");
+            result.failed = true;
+            return;
+        }
+
+        client.channel = std::make_unique<UdpChannel>(
+            SocketAddress_t{}, Utils::getTime());
+        client.channel->connect(hello.base(), hello.size(), Utils::getTime());
+    }
+
+    LossFilter filter(config.loss);
+
+    std::vector<SocketReady_t> ready;
+    std::vector<SocketDatagram_t> datagrams(NETWORK_UDP_BATCH);
+    std::vector<uint8_t> data(NETWORK_UDP_BATCH * NETWORK_UDP_PACKET_SIZE);
+    std::vector<SocketDatagram_t> sendDatagrams;
+
+    while (!_stopClients)
+    {
+        ready.clear();
+        poller->Wait(1, ready);
+
+        const double now = Utils::getTime();
+        for (const auto& entry : ready)
+        {
+            auto& client = *static_cast<LossClient_t*>(entry.userData);
+            while (true)
+            {
+                for (size_t i = 0; i < datagrams.size(); i++)
+                {
+                    datagrams[i].data = data.data()
+                                        + i * NETWORK_UDP_PACKET_SIZE;
+                    datagrams[i].size = NETWORK_UDP_PACKET_SIZE;
+                }
+
+                const size_t count = client.sock->ReceiveMany(
+                    datagrams.data(), datagrams.size());
+                for (size_t i = 0; i < count; i++)
+                {
+                    result.datagrams++;
+                    if (filter.drop())
+                    {
+                        result.dropped++;
+                        continue;
+                    }
+                    client.channel->processPacket(
+                        datagrams[i].data, datagrams[i].size, now);
+                }
+
+                if (count < datagrams.size())
+                    break;
+            }
+
+            client.channel->getReceivedMessages().clear();
+            processStream(client, result);
+        }
+
+        for (auto& client : clients)
+        {
+            sendDatagrams.clear();
+            client.channel->writePackets(now, sendDatagrams);
+
+            size_t kept = 0;
+            for (const auto& datagram : sendDatagrams)
+            {
+                result.datagrams++;
+                if (filter.drop())
+                    result.dropped++;
+                else
+                    sendDatagrams[kept++] = datagram;
+            }
+            client.sock->SendMany(sendDatagrams.data(), kept);
+        }
+    }
+}
+
+// Runs the server loop of the dedicated server until the given tick.
+static void runServer(uint32_t endTick)
+{
+    double nextTick = Utils::getTime() + GAME_TICK_RATE;
+
+    while (gGame.getTick() < endTick)
+    {
+        const double now = Utils::getTime();
+        if (now < nextTick)
+        {
+            const int32_t timeoutMs = static_cast<int32_t>(
+                (nextTick - now) * 1000.0 + 1.0);
+            gNetwork.wait(timeoutMs);
+            gNetwork.update();
+            gNetwork.flush();
+            continue;
+        }
+
+        _tickStart[(gGame.getTick() + 1) % TICK_HISTORY] = now;
+
+        gGame.update();
+        nextTick += GAME_TICK_RATE;
+        if (nextTick < now)
+            nextTick = now + GAME_TICK_RATE;
+    }
+}
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty())
+        return 0.0;
+
+    const size_t index = static_cast<size_t>(p * (sorted.size() - 1));
+    return sorted[index];
+}
+
+static bool parseArgs(int argc, char** argv, BenchConfig_t& config)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            printf("ERROR: Missing value for %s\n", arg);
+            return false;
+        }
+
+        const char* value = argv[++i];
+        if (strcmp(arg, "--clients") == 0)
+            config.clients = static_cast<uint32_t>(atol(value));
+        else if (strcmp(arg, "--ticks") == 0)
+            config.ticks = static_cast<uint32_t>(atol(value));
+        else if (strcmp(arg, "--loss") == 0)
+            config.loss = atof(value);
+        else if (strcmp(arg, "--bots") == 0)
+            config.bots = static_cast<uint32_t>(atol(value));
+        else if (strcmp(arg, "--port") == 0)
+            config.port = static_cast<uint16_t>(atol(value));
+        else if (strcmp(arg, "--width") == 0)
+            config.arena.width = atoi(value);
+        else if (strcmp(arg, "--height") == 0)
+            config.arena.height = atoi(value);
+        else
+        {
+            printf("ERROR: Unknown option %s\n", arg);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    BenchConfig_t config;
+    config.arena.width = 256;
+    config.arena.height = 256;
+
+    if (!parseArgs(argc, argv, config))
+        return EXIT_FAILURE;
+
+    config.arena.maxPlayers = config.clients + config.bots;
+    if (!gGame.setArena(config.arena))
+    {
+        printf(
+            "ERROR: Invalid arena: %d x %d, %u players\n", config.arena.width,
+            config.arena.height, config.arena.maxPlayers);
+        return EXIT_FAILURE;
+    }
+
+    gLogging.setEnabled(false);
+    gNetwork.startServer(
+        "127.0.0.1", config.port, NetworkBackend::SOCKETS, 0,
+        NetworkTransport::UDP);
+    gBots.add(config.bots);
+    gGame.init(nullptr);
+
+    printf(
+        "%u clients, %.1f%% loss each way, %u bots, %u ticks\n",
+        config.clients, config.loss, config.bots, config.ticks);
+
+    ClientsResult_t clients;
+    std::thread clientThread(runClients, std::cref(config), std::ref(clients));
+
+    // Everyone receives frames before the measurement starts.
+    while (clients.joined < config.clients && !clients.failed)
+    {
+        runServer(gGame.getTick() + 1);
+    }
+
+    _measure = true;
+    runServer(gGame.getTick() + config.ticks);
+    _measure = false;
+
+    // The last frames are still on their way.
+    runServer(gGame.getTick() + 10);
+
+    _stopClients = true;
+    clientThread.join();
+
+    if (clients.failed)
+        return EXIT_FAILURE;
+
+    std::vector<double>& latencies = clients.latencies;
+    std::sort(latencies.begin(), latencies.end());
+
+    const size_t late = latencies.end()
+                        - std::upper_bound(
+                            latencies.begin(), latencies.end(),
+                            GAME_TICK_RATE);
+
+    printf(
+        "%8s %8s %8s %8s %8s %8s %10s\n", "frames", "p50 ms", "p90 ms",
+        "p99 ms", "max ms", "late", "dropped");
+    printf(
+        "%8zu %8.2f %8.2f %8.2f %8.2f %8zu %9.1f%%\n", latencies.size(),
+        percentile(latencies, 0.5) * 1000.0,
+        percentile(latencies, 0.9) * 1000.0,
+        percentile(latencies, 0.99) * 1000.0,
+        latencies.empty() ? 0.0 : latencies.back() * 1000.0, late,
+        clients.datagrams == 0
+            ? 0.0
+            : clients.dropped * 100.0 / clients.datagrams);
+
+    // Reliable means every frame, in order.
+    if (clients.outOfOrder > 0)
+    {
+        printf(
+            "ERROR: %u frames missing or out of order\n",
+            clients.outOfOrder);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
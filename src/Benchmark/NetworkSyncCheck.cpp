@@ -0,0 +1,208 @@
+// Runs a server with bots on the loopback interface against real clients,
+// each in a process of its own that simulates the game, see SyncClient.h.
+// Fails if any client saw its state differ from the server or if fewer
+// rounds than asked for ended. The arena is small so rounds end quickly, and
+// everything ticks --speed times faster than the game.
+//
+//   NetworkSyncCheck [--clients N] [--rounds N] [--ticks N] [--bots N]
+//                    [--port N] [--width N] [--height N] [--speed N]
+//                    [--transport tcp|udp]
+//
+// Linux only, like NetworkBenchmark.
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+#include <vector>
+
+#include "Bots.h"
+#include "Game.h"
+#include "Logging.h"
+#include "Network.h"
+#include "SyncClient.h"
+#include "Utils.h"
+
+struct CheckConfig_t
+{
+    ArenaConfig_t arena;
+    uint32_t clients = 2;
+    uint32_t rounds = 3;
+    uint32_t ticks = 4000;
+    uint32_t bots = 2;
+    uint16_t port = 11757;
+    double speed = 4.0;
+    NetworkTransport transport = NetworkTransport::TCP;
+};
+
+// Runs the server loop of the dedicated server until the given tick, counts
+// the rounds that end.
+static void runServer(uint32_t endTick, double tickRate, uint32_t& rounds)
+{
+    double nextTick = Utils::getTime() + tickRate;
+
+    while (gGame.getTick() < endTick)
+    {
+        const double now = Utils::getTime();
+        if (now < nextTick)
+        {
+            const int32_t timeoutMs = static_cast<int32_t>(
+                (nextTick - now) * 1000.0 + 1.0);
+            gNetwork.wait(timeoutMs);
+            gNetwork.update();
+            gNetwork.flush();
+            continue;
+        }
+
+        const RoundState roundState = gGame.getRoundState();
+        gGame.update();
+        if (roundState == RoundState::RUNNING
+            && gGame.getRoundState() == RoundState::RESTARTING)
+        {
+            rounds++;
+        }
+
+        nextTick += tickRate;
+        if (nextTick < now)
+            nextTick = now + tickRate;
+    }
+}
+
+static bool parseArgs(int argc, char** argv, CheckConfig_t& config)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            printf("ERROR: Missing value for %s\n", arg);
+            return false;
+        }
+
+        const char* value = argv[++i];
+        if (strcmp(arg, "--clients") == 0)
+            config.clients = static_cast<uint32_t>(atol(value));
+        else if (strcmp(arg, "--rounds") == 0)
+            config.rounds = static_cast<uint32_t>(atol(value));
+        else if (strcmp(arg, "--ticks") == 0)
+            config.ticks = static_cast<uint32_t>(atol(value));
+        else if (strcmp(arg, "--bots") == 0)
+            config.bots = static_cast<uint32_t>(atol(value));
+        else if (strcmp(arg, "--port") == 0)
+            config.port = static_cast<uint16_t>(atol(value));
+        else if (strcmp(arg, "--width") == 0)
+            config.arena.width = atoi(value);
+        else if (strcmp(arg, "--height") == 0)
+            config.arena.height = atoi(value);
+        else if (strcmp(arg, "--speed") == 0 && atof(value) > 0.0)
+            config.speed = atof(value);
+        else if (strcmp(arg, "--transport") == 0 && strcmp(value, "udp") == 0)
+            config.transport = NetworkTransport::UDP;
+        else if (strcmp(arg, "--transport") == 0 && strcmp(value, "tcp") == 0)
+            config.transport = NetworkTransport::TCP;
+        else
+        {
+            printf("ERROR: Unknown option %s\n", arg);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    CheckConfig_t config;
+    config.arena.width = 24;
+    config.arena.height = 16;
+
+    if (!parseArgs(argc, argv, config))
+        return EXIT_FAILURE;
+
+    gLogging.setEnabled(false);
+
+    config.arena.maxPlayers = config.clients + config.bots;
+    if (!gGame.setArena(config.arena))
+    {
+        printf(
+            "ERROR: Invalid arena: %d x %d, %u players\n", config.arena.width,
+            config.arena.height, config.arena.maxPlayers);
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    // The clients are forked before anything of the server exists.
+    const double tickRate = GAME_TICK_RATE / config.speed;
+    std::vector<std::unique_ptr<SyncClient>> clients;
+    for (uint32_t i = 0; i < config.clients; i++)
+    {
+        auto client = std::make_unique<SyncClient>();
+        if (!client->fork(config.port, config.transport, tickRate))
+        {
+            printf("ERROR: Unable to start client %u\n", i);
+            return EXIT_FAILURE;
+        }
+        clients.push_back(std::move(client));
+    }
+
+    gNetwork.startServer(
+        "127.0.0.1", config.port, NetworkBackend::SOCKETS, 0,
+        config.transport);
+    gBots.add(config.bots);
+    gGame.init(nullptr);
+
+    printf(
+        "%u clients over %s, %u bots, %d x %d, %u rounds\n", config.clients,
+        config.transport == NetworkTransport::UDP ? "udp" : "tcp",
+        config.bots, config.arena.width, config.arena.height,
+        config.rounds);
+
+    for (auto& client : clients)
+    {
+        client->start();
+    }
+
+    uint32_t rounds = 0;
+    while (rounds < config.rounds && gGame.getTick() < config.ticks)
+    {
+        runServer(gGame.getTick() + 1, tickRate, rounds);
+    }
+
+    bool failed = rounds < config.rounds;
+    if (failed)
+    {
+        printf(
+            "ERROR: Only %u of %u rounds ended in %u ticks\n", rounds,
+            config.rounds, gGame.getTick());
+    }
+
+    printf(
+        "%8s %8s %8s %8s %8s\n", "client", "tick", "rounds", "desyncs",
+        "desynced");
+    for (size_t i = 0; i < clients.size(); i++)
+    {
+        SyncResult_t result;
+        if (!clients[i]->finish(result))
+        {
+            printf("ERROR: Client %zu did not report\n", i);
+            failed = true;
+            continue;
+        }
+
+        printf(
+            "%8zu %8u %8u %8u %8s\n", i, result.tick, result.rounds,
+            result.desyncs, result.desynced ? "yes" : "no");
+
+        if (!result.joined || result.desyncs > 0 || result.desynced)
+            failed = true;
+    }
+
+    if (failed)
+    {
+        printf("ERROR: Clients did not stay in sync\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
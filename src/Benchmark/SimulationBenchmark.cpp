@@ -0,0 +1,391 @@
+// Runs the simulation headless and flat-out with synthetic players and
+// reports the tick throughput of Game::update, Snakes::update,
+// Players::update and Bots::update. Every target starts from the same seed, so runs with the
+// same options simulate the same world and can be compared for regressions.
+//
+//   SimulationBenchmark [--width N] [--height N] [--snakes N] [--ticks N]
+//                       [--threads N] [--seed N] [--target NAME]
+//                       [--check-threads N]
+//
+// Allocations are counted by replacing the global operator new, only the
+// ones made inside the timed calls are reported. The state hash at the end
+// must not change with the thread count, --check-threads runs every target
+// again with N threads and fails if it does.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "Bots.h"
+#include "Game.h"
+#include "Logging.h"
+#include "Players.h"
+#include "Snakes.h"
+#include "ThreadPool.h"
+#include "TileMap.h"
+
+static std::atomic<uint64_t> _allocCount{ 0 };
+
+void* operator new(size_t size)
+{
+    _allocCount.fetch_add(1, std::memory_order_relaxed);
+    void* ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t size) noexcept
+{
+    free(ptr);
+}
+
+using BenchClock = std::chrono::steady_clock;
+
+struct BenchConfig_t
+{
+    ArenaConfig_t arena;
+    uint32_t snakes = 4096;
+    uint32_t ticks = 2000;
+    uint32_t threads = 1;
+    uint32_t seed = 1;
+    uint32_t checkThreads = 0;
+    std::string target = "all";
+};
+
+struct BenchResult_t
+{
+    std::vector<uint64_t> tickNs;
+    uint64_t allocs = 0;
+    uint32_t rounds = 0;
+    uint64_t stateHash = 0;
+};
+
+enum class BenchTarget
+{
+    GAME,
+    SNAKES,
+    PLAYERS,
+    BOTS,
+};
+
+// Steering for the synthetic players, independent of the game RNG so it
+// does not change what the simulation does with its own random numbers.
+class BotInput
+{
+    uint32_t _state;
+
+public:
+    explicit BotInput(uint32_t seed)
+        : _state(seed != 0 ? seed : 1)
+    {
+    }
+
+    uint32_t next()
+    {
+        _state ^= _state << 13;
+        _state ^= _state >> 17;
+        _state ^= _state << 5;
+        return _state;
+    }
+
+    void steer()
+    {
+        static constexpr Vector2i DIRECTIONS[] = {
+            DIR_UP,
+            DIR_RIGHT,
+            DIR_DOWN,
+            DIR_LEFT,
+        };
+
+        for (const Snake& snake : gSnakes.getSnakes())
+        {
+            if (snake.id == INVALID_SNAKE_ID
+                || snake.state != SnakeState::ALIVE)
+                continue;
+
+            const uint32_t rand = next();
+            if (snake.direction == DIR_NONE)
+            {
+                gSnakes.setDirection(snake.id, DIRECTIONS[rand % 4]);
+                continue;
+            }
+
+            // Turn left or right every 8 ticks on average, never reverse.
+            if ((rand & 7) != 0)
+                continue;
+
+            Vector2i dir = snake.direction;
+            if ((rand & 8) != 0)
+                dir = Vector2i{ -dir.y, dir.x };
+            else
+                dir = Vector2i{ dir.y, -dir.x };
+
+            gSnakes.setDirection(snake.id, dir);
+        }
+    }
+};
+
+static bool setupWorld(const BenchConfig_t& config, BenchTarget target)
+{
+    ArenaConfig_t arena = config.arena;
+    arena.maxPlayers = config.snakes;
+    if (!gGame.setArena(arena))
+        return false;
+
+    gGame.setTick(0);
+    gGame.setRandState(config.seed);
+
+    // Bots steer every snake on their own, timing them is the point.
+    if (target == BenchTarget::BOTS)
+    {
+        gBots.add(config.snakes);
+        gGame.startRound();
+        return true;
+    }
+
+    for (uint32_t i = 0; i < config.snakes; i++)
+    {
+        char name[32]{};
+        snprintf(name, sizeof(name), "Bot%u", i);
+
+        // The first bot is local so Players::update has input to poll.
+        if (i == 0)
+            gPlayers.createLocalPlayer(name, INVALID_SNAKE_ID);
+        else
+            gPlayers.createPlayer(name, INVALID_SNAKE_ID);
+    }
+
+    gGame.startRound();
+    return true;
+}
+
+static bool runTarget(
+    const BenchConfig_t& config, BenchTarget target, BenchResult_t& result)
+{
+    if (!setupWorld(config, target))
+        return false;
+
+    BotInput bots(config.seed);
+
+    result.tickNs.clear();
+    result.tickNs.reserve(config.ticks);
+    result.allocs = 0;
+    result.rounds = 1;
+
+    for (uint32_t tick = 0; tick < config.ticks; tick++)
+    {
+        if (gSnakes.alive() == 0)
+        {
+            gGame.startRound();
+            result.rounds++;
+        }
+
+        if (target != BenchTarget::BOTS)
+            bots.steer();
+
+        const uint64_t allocStart = _allocCount.load();
+        const auto start = BenchClock::now();
+
+        switch (target)
+        {
+            case BenchTarget::GAME:
+                gGame.update();
+                break;
+            case BenchTarget::SNAKES:
+                gSnakes.update();
+                break;
+            case BenchTarget::PLAYERS:
+                gPlayers.update();
+                break;
+            case BenchTarget::BOTS:
+                gBots.update();
+                break;
+        }
+
+        const auto end = BenchClock::now();
+        result.allocs += _allocCount.load() - allocStart;
+
+        if (target == BenchTarget::BOTS)
+            gSnakes.update();
+
+        result.tickNs.push_back(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+                .count());
+    }
+
+    result.stateHash = gGame.getStateHash();
+    return true;
+}
+
+static uint64_t percentile(const std::vector<uint64_t>& sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+
+    const size_t index = static_cast<size_t>(p * (sorted.size() - 1));
+    return sorted[index];
+}
+
+static void printResult(const char* name, BenchResult_t& result)
+{
+    std::vector<uint64_t>& tickNs = result.tickNs;
+
+    uint64_t totalNs = 0;
+    for (uint64_t ns : tickNs)
+    {
+        totalNs += ns;
+    }
+
+    std::sort(tickNs.begin(), tickNs.end());
+
+    const double ticksPerSec = totalNs > 0
+                                   ? tickNs.size() * 1e9 / totalNs
+                                   : 0.0;
+    const double allocsPerTick = tickNs.empty()
+                                     ? 0.0
+                                     : double(result.allocs) / tickNs.size();
+
+    printf(
+        "%-8s %12.1f %10llu %10llu %10llu %10llu %12.2f %7u %016llx\n", name,
+        ticksPerSec, static_cast<unsigned long long>(percentile(tickNs, 0.5)),
+        static_cast<unsigned long long>(percentile(tickNs, 0.9)),
+        static_cast<unsigned long long>(percentile(tickNs, 0.99)),
+        static_cast<unsigned long long>(tickNs.empty() ? 0 : tickNs.back()),
+        allocsPerTick, result.rounds,
+        static_cast<unsigned long long>(result.stateHash));
+}
+
+static bool parseArgs(int argc, char** argv, BenchConfig_t& config)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            printf("ERROR: Missing value for %s\n", arg);
+            return false;
+        }
+
+        const char* value = argv[++i];
+        if (strcmp(arg, "--width") == 0)
+            config.arena.width = atoi(value);
+        else if (strcmp(arg, "--height") == 0)
+            config.arena.height = atoi(value);
+        else if (strcmp(arg, "--snakes") == 0)
+            config.snakes = static_cast<uint32_t>(atol(value));
+        else if (strcmp(arg, "--ticks") == 0)
+            config.ticks = static_cast<uint32_t>(atol(value));
+        else if (strcmp(arg, "--threads") == 0)
+            config.threads = static_cast<uint32_t>(atol(value));
+        else if (strcmp(arg, "--seed") == 0)
+            config.seed = static_cast<uint32_t>(atol(value));
+        else if (strcmp(arg, "--target") == 0)
+            config.target = value;
+        else if (strcmp(arg, "--check-threads") == 0)
+            config.checkThreads = static_cast<uint32_t>(atol(value));
+        else
+        {
+            printf("ERROR: Unknown option %s\n", arg);
+            return false;
+        }
+    }
+
+    if (config.seed == 0)
+    {
+        printf("ERROR: The seed must not be 0\n");
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    BenchConfig_t config;
+    config.arena.width = 1024;
+    config.arena.height = 1024;
+
+    if (!parseArgs(argc, argv, config))
+        return EXIT_FAILURE;
+
+    // Round starts are logged, keep the output to the results.
+    gLogging.setEnabled(false);
+    gThreadPool.init(config.threads);
+
+    printf(
+        "map %d x %d, %u snakes, %u ticks, %u threads, seed %u\n",
+        config.arena.width, config.arena.height, config.snakes, config.ticks,
+        config.threads, config.seed);
+    printf(
+        "%-8s %12s %10s %10s %10s %10s %12s %7s %16s\n", "target",
+        "ticks/sec", "p50 ns", "p90 ns", "p99 ns", "max ns", "allocs/tick",
+        "rounds", "state hash");
+
+    static constexpr struct
+    {
+        const char* name;
+        BenchTarget target;
+    } TARGETS[] = {
+        { "game", BenchTarget::GAME },
+        { "snakes", BenchTarget::SNAKES },
+        { "players", BenchTarget::PLAYERS },
+        { "bots", BenchTarget::BOTS },
+    };
+
+    bool found = false;
+    BenchResult_t result;
+    for (const auto& target : TARGETS)
+    {
+        if (config.target != "all" && config.target != target.name)
+            continue;
+
+        found = true;
+        if (!runTarget(config, target.target, result))
+        {
+            printf(
+                "ERROR: Invalid arena: %d x %d, %u snakes\n",
+                config.arena.width, config.arena.height, config.snakes);
+            return EXIT_FAILURE;
+        }
+        printResult(target.name, result);
+
+        if (config.checkThreads == 0)
+            continue;
+
+        const uint64_t stateHash = result.stateHash;
+        gThreadPool.init(config.checkThreads);
+        runTarget(config, target.target, result);
+        gThreadPool.init(config.threads);
+        printResult(target.name, result);
+
+        if (result.stateHash != stateHash)
+        {
+            printf(
+                "ERROR: State hash of %s differs with %u threads\n",
+                target.name, config.checkThreads);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!found)
+    {
+        printf("ERROR: Unknown target %s\n", config.target.c_str());
+        return EXIT_FAILURE;
+    }
+
+    gThreadPool.shutdown();
+    return EXIT_SUCCESS;
+}
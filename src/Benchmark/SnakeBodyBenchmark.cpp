@@ -0,0 +1,82 @@
+// Compares moving a snake body stored in a std::vector with front inserts
+// against the SnakeBody ring buffer. Only depends on SnakeBody.h so it can be
+// built standalone, e.g.:
+//   g++ -O2 -std=c++17 -I../SnakeRoyal SnakeBodyBenchmark.cpp -o SnakeBodyBenchmark
+
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+
+#include "SnakeBody.h"
+
+static constexpr size_t BENCH_MOVES = 1000000;
+
+using BenchClock = std::chrono::high_resolution_clock;
+
+static double nsPerMove(BenchClock::time_point start, BenchClock::time_point end)
+{
+    return std::chrono::duration<double, std::nano>(end - start).count()
+           / BENCH_MOVES;
+}
+
+static double benchVector(size_t length)
+{
+    std::vector<Vector2i> pieces;
+    for (size_t i = 0; i < length; i++)
+    {
+        pieces.push_back({ static_cast<int32_t>(i), 0 });
+    }
+
+    auto start = BenchClock::now();
+    for (size_t i = 0; i < BENCH_MOVES; i++)
+    {
+        Vector2i head = pieces[0] + DIR_LEFT;
+        pieces.insert(pieces.begin(), head);
+        pieces.pop_back();
+    }
+    auto end = BenchClock::now();
+
+    // Keep the result alive.
+    volatile int32_t sink = pieces.back().x;
+    (void)sink;
+
+    return nsPerMove(start, end);
+}
+
+static double benchRing(size_t length)
+{
+    SnakeBody pieces;
+    for (size_t i = 0; i < length; i++)
+    {
+        pieces.pushBack({ static_cast<int32_t>(i), 0 });
+    }
+
+    auto start = BenchClock::now();
+    for (size_t i = 0; i < BENCH_MOVES; i++)
+    {
+        Vector2i head = pieces.front() + DIR_LEFT;
+        pieces.popBack();
+        pieces.pushFront(head);
+    }
+    auto end = BenchClock::now();
+
+    volatile int32_t sink = pieces.back().x;
+    (void)sink;
+
+    return nsPerMove(start, end);
+}
+
+int main()
+{
+    printf("%10s %16s %16s\n", "length", "vector ns/move", "ring ns/move");
+
+    for (size_t length = 4; length <= 16384; length *= 4)
+    {
+        double vectorNs = benchVector(length);
+        double ringNs = benchRing(length);
+        printf("%10zu %16.2f %16.2f\n", length, vectorNs, ringNs);
+    }
+
+    return 0;
+}
@@ -0,0 +1,220 @@
+#pragma once
+
+// A real game client for the loopback tools. The game state is global, so
+// it runs in a process of its own that is forked before the server starts.
+// It simulates like the game does, turns its snake now and then so rounds
+// come to an end, and reports how often its state did not match the server.
+//
+// Linux only, like the tools using it.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+
+#include "Game.h"
+#include "Network.h"
+#include "Players.h"
+#include "Prediction.h"
+#include "Snakes.h"
+#include "Utils.h"
+
+// Ticks between the turns of the client.
+static constexpr uint32_t SYNC_CLIENT_TURN_TICKS = 6;
+
+struct SyncResult_t
+{
+    // Set once the first frame arrived.
+    bool joined = false;
+
+    // Last tick simulated and the round ends seen.
+    uint32_t tick = 0;
+    uint32_t rounds = 0;
+
+    // Each desync asked the server for a resync, see
+    // Network::getDesyncCount.
+    uint32_t desyncs = 0;
+    bool desynced = false;
+};
+
+class SyncClient
+{
+    pid_t _pid = -1;
+    int _control = -1;
+
+public:
+    ~SyncClient()
+    {
+        if (_control != -1)
+            close(_control);
+    }
+
+    // Forks the client, it connects once start is called. The server must
+    // not be started yet, none of it may end up in the child. The client
+    // ticks as often as given in seconds.
+    bool fork(uint16_t port, NetworkTransport transport, double tickRate)
+    {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+            return false;
+
+        _pid = ::fork();
+        if (_pid == -1)
+        {
+            close(fds[0]);
+            close(fds[1]);
+            return false;
+        }
+
+        if (_pid == 0)
+        {
+            close(fds[0]);
+            run(fds[1], port, transport, tickRate);
+        }
+
+        close(fds[1]);
+        _control = fds[0];
+        return true;
+    }
+
+    void start()
+    {
+        const char command = 's';
+        send(_control, &command, 1, MSG_NOSIGNAL);
+    }
+
+    // Stops the client and collects its result, false if it did not report
+    // one.
+    bool finish(SyncResult_t& result)
+    {
+        const char command = 'q';
+        send(_control, &command, 1, MSG_NOSIGNAL);
+
+        const ssize_t res = recv(
+            _control, &result, sizeof(result), MSG_WAITALL);
+
+        int status = 0;
+        waitpid(_pid, &status, 0);
+
+        return res == static_cast<ssize_t>(sizeof(result))
+               && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+    }
+
+private:
+    [[noreturn]] static void run(
+        int control, uint16_t port, NetworkTransport transport,
+        double tickRate)
+    {
+        SyncResult_t result;
+
+        // Nothing to connect to before the server is up.
+        char command = 0;
+        if (recv(control, &command, 1, 0) != 1)
+            _exit(EXIT_FAILURE);
+
+        gNetwork.startClient("127.0.0.1", port, transport);
+        gGame.init(nullptr);
+
+        // Each client turns differently.
+        uint32_t rand = static_cast<uint32_t>(getpid());
+        uint32_t turnTick = 0;
+        RoundState roundState = gGame.getRoundState();
+        double nextTick = Utils::getTime() + tickRate;
+
+        // Stopped by the parent, or it is gone.
+        while (recv(control, &command, 1, MSG_DONTWAIT) < 0)
+        {
+            // Dropped by the server, wait to be stopped.
+            if (gNetwork.getMode() != NetworkMode::CLIENT)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+
+            gNetwork.update();
+
+            const double now = Utils::getTime();
+            if (now < nextTick)
+            {
+                gNetwork.flush();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+
+            nextTick += tickRate;
+            if (nextTick < now)
+                nextTick = now + tickRate;
+
+            gGame.update();
+
+            if (roundState == RoundState::RUNNING
+                && gGame.getRoundState() == RoundState::RESTARTING)
+            {
+                result.rounds++;
+            }
+            roundState = gGame.getRoundState();
+
+            if (roundState == RoundState::RUNNING
+                && gGame.getTick() >= turnTick)
+            {
+                turn(rand);
+                turnTick = gGame.getTick() + SYNC_CLIENT_TURN_TICKS;
+            }
+
+            gNetwork.flush();
+
+            result.joined = result.joined || gNetwork.getServerTick() > 0;
+        }
+
+        result.tick = gGame.getTick();
+        result.desyncs = gNetwork.getDesyncCount();
+        result.desynced = gNetwork.isDesynced();
+
+        send(control, &result, sizeof(result), MSG_NOSIGNAL);
+
+        // The globals of the game are not torn down, the parent owns what
+        // they were copied from.
+        _exit(EXIT_SUCCESS);
+    }
+
+    // Turns the local snake like a player would, including straight back
+    // into itself.
+    static void turn(uint32_t& rand)
+    {
+        static constexpr Vector2i DIRECTIONS[] = {
+            DIR_UP,
+            DIR_RIGHT,
+            DIR_DOWN,
+            DIR_LEFT,
+        };
+
+        const PlayerId playerId = gPlayers.getLocalPlayerId();
+        if (!gPlayers.isValidPlayer(playerId))
+            return;
+
+        const SnakeId snakeId = gPlayers.getPlayer(playerId).snakeId;
+        if (snakeId == INVALID_SNAKE_ID)
+            return;
+
+        rand ^= rand << 13;
+        rand ^= rand >> 17;
+        rand ^= rand << 5;
+
+        const Vector2i direction = DIRECTIONS[rand % 4];
+        if (direction
+            == gPrediction.getLocalDirection(gSnakes.getDirection(snakeId)))
+            return;
+
+        gPrediction.setLocalDirection(direction);
+
+        MessageClientSnakeDirection msgSnakeDir;
+        msgSnakeDir.tick = gPrediction.getInputTick();
+        msgSnakeDir.sequence = gPrediction.getInputSequence();
+        msgSnakeDir.newDirection = direction;
+
+        gNetwork.sendMessage(msgSnakeDir);
+    }
+};
@@ -0,0 +1,176 @@
+// Headless server without any window, for Linux and other POSIX systems.
+// Sleeps on the client sockets between ticks, only the ones that sent
+// something are read from so idle connections cost nothing.
+//
+//   SnakeRoyalServer [--host ADDRESS] [--port N] [--width N] [--height N]
+//                    [--max-players N] [--bots N] [--threads N]
+//                    [--backend sockets|ring] [--net-threads N]
+//                    [--transport tcp|udp]
+//
+// The ring backend batches the receives and sends of all clients into a
+// few io_uring calls per tick, Linux only. With --net-threads the sockets
+// backend receives and sends on that many threads of its own, the tick
+// loop only handles whole messages. With the UDP transport clients can
+// join over UDP as well, only with the sockets backend and no threads.
+//
+// Every client needs a file descriptor, the limit is raised as far as the
+// system allows on startup.
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <string>
+
+#include "Bots.h"
+#include "Game.h"
+#include "Logging.h"
+#include "Network.h"
+#include "ThreadPool.h"
+#include "Utils.h"
+
+struct ServerConfig_t
+{
+    ArenaConfig_t arena;
+    std::string host = NETWORK_DEFAULT_HOST;
+    uint16_t port = NETWORK_DEFAULT_PORT;
+    uint32_t bots = 0;
+    uint32_t threads = 1;
+    uint32_t netThreads = 0;
+    NetworkBackend backend = NetworkBackend::SOCKETS;
+    NetworkTransport transport = NetworkTransport::TCP;
+};
+
+static volatile sig_atomic_t _quit = 0;
+
+static void onSignal(int)
+{
+    _quit = 1;
+}
+
+static bool parseArgs(int argc, char** argv, ServerConfig_t& config)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            printf("ERROR: Missing value for %s\n", arg);
+            return false;
+        }
+
+        const char* value = argv[++i];
+        if (strcmp(arg, "--host") == 0)
+            config.host = value;
+        else if (strcmp(arg, "--port") == 0)
+            config.port = static_cast<uint16_t>(atol(value));
+        else if (strcmp(arg, "--width") == 0)
+            config.arena.width = atoi(value);
+        else if (strcmp(arg, "--height") == 0)
+            config.arena.height = atoi(value);
+        else if (strcmp(arg, "--max-players") == 0)
+            config.arena.maxPlayers = static_cast<uint32_t>(atol(value));
+        else if (strcmp(arg, "--bots") == 0)
+            config.bots = static_cast<uint32_t>(atol(value));
+        else if (strcmp(arg, "--threads") == 0)
+            config.threads = static_cast<uint32_t>(atol(value));
+        else if (strcmp(arg, "--backend") == 0 && strcmp(value, "ring") == 0)
+            config.backend = NetworkBackend::RING;
+        else if (strcmp(arg, "--backend") == 0
+                 && strcmp(value, "sockets") == 0)
+            config.backend = NetworkBackend::SOCKETS;
+        else if (strcmp(arg, "--net-threads") == 0)
+            config.netThreads = static_cast<uint32_t>(atol(value));
+        else if (strcmp(arg, "--transport") == 0 && strcmp(value, "udp") == 0)
+            config.transport = NetworkTransport::UDP;
+        else if (strcmp(arg, "--transport") == 0 && strcmp(value, "tcp") == 0)
+            config.transport = NetworkTransport::TCP;
+        else
+        {
+            printf("ERROR: Unknown option %s\n", arg);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void raiseFileLimit()
+{
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+        return;
+
+    if (limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        getrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    logPrint(
+        "File descriptor limit: %llu\n",
+        static_cast<unsigned long long>(limit.rlim_cur));
+}
+
+int main(int argc, char** argv)
+{
+    ServerConfig_t config;
+    if (!parseArgs(argc, argv, config))
+        return EXIT_FAILURE;
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    raiseFileLimit();
+    gThreadPool.init(config.threads);
+
+    if (!gGame.setArena(config.arena))
+    {
+        logPrint(
+            "ERROR: Invalid arena: %d x %d, %u players\n", config.arena.width,
+            config.arena.height, config.arena.maxPlayers);
+        return EXIT_FAILURE;
+    }
+
+    gNetwork.startServer(
+        config.host, config.port, config.backend, config.netThreads,
+        config.transport);
+
+    if (gBots.add(config.bots) != config.bots)
+    {
+        logPrint("WARNING: Only room for %zu bots\n", gBots.count());
+    }
+
+    gGame.init(nullptr);
+
+    double nextTick = Utils::getTime() + GAME_TICK_RATE;
+    while (!_quit)
+    {
+        const double now = Utils::getTime();
+        if (now < nextTick)
+        {
+            // Round up, waking early would only wait again.
+            const int32_t timeoutMs = static_cast<int32_t>(
+                (nextTick - now) * 1000.0 + 1.0);
+            gNetwork.wait(timeoutMs);
+            gNetwork.update();
+            gNetwork.flush();
+            continue;
+        }
+
+        gGame.update();
+        nextTick += GAME_TICK_RATE;
+
+        // Ticks are not made up for after a stall, clients would only be
+        // flooded with them.
+        if (nextTick < now)
+            nextTick = now + GAME_TICK_RATE;
+    }
+
+    logPrint("Shutting down...\n");
+    gThreadPool.shutdown();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,171 @@
+#include "Bots.h"
+#include "Network.h"
+#include "Players.h"
+#include "Snakes.h"
+#include "TileMap.h"
+#include <stdio.h>
+
+Bots gBots;
+
+static constexpr Vector2i BOT_DIRECTIONS[] = {
+    DIR_UP,
+    DIR_RIGHT,
+    DIR_DOWN,
+    DIR_LEFT,
+};
+
+uint32_t Bots::add(uint32_t count)
+{
+    uint32_t added = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        char name[128]{};
+        snprintf(
+            name, sizeof(name), "Bot %u",
+            static_cast<uint32_t>(_bots.size() + 1));
+
+        PlayerId playerId = gPlayers.createPlayer(name, INVALID_SNAKE_ID);
+        if (playerId == INVALID_PLAYER_ID)
+            break;
+
+        _bots.push_back(playerId);
+        added++;
+    }
+    return added;
+}
+
+void Bots::clear()
+{
+    _bots.clear();
+}
+
+size_t Bots::count() const
+{
+    return _bots.size();
+}
+
+void Bots::update()
+{
+    if (gNetwork.getMode() == NetworkMode::CLIENT || _bots.empty())
+        return;
+
+    const size_t words = (gTileMap.size() + 63) / 64;
+    if (_visited.size() != words)
+        _visited.assign(words, 0);
+
+    _queue.resize(BOT_SEARCH_CELLS);
+
+    for (PlayerId playerId : _bots)
+    {
+        updateBot(playerId);
+    }
+}
+
+// Breadth first search from the head towards the closest food, each queued
+// cell remembers which direction it was reached by. Without food in reach
+// the bot heads where the most free cells were found.
+void Bots::updateBot(PlayerId playerId)
+{
+    const Player& player = gPlayers.getPlayer(playerId);
+    if (player.snakeId == INVALID_SNAKE_ID)
+        return;
+
+    const Snake& snake = gSnakes.getData(player.snakeId);
+    if (snake.state != SnakeState::ALIVE || snake.pieces.empty())
+        return;
+
+    const int32_t width = gTileMap.getWidth();
+    const int32_t height = gTileMap.getHeight();
+
+    auto tryQueue = [&](const Vector2i& from, uint32_t dir,
+                        uint32_t firstDir, size_t& tail) -> void {
+        // Neighbors are at most one cell outside, no need for Utils::mod.
+        Vector2i pos = from + BOT_DIRECTIONS[dir];
+        if (pos.x < 0)
+            pos.x += width;
+        else if (pos.x >= width)
+            pos.x -= width;
+        if (pos.y < 0)
+            pos.y += height;
+        else if (pos.y >= height)
+            pos.y -= height;
+
+        const uint32_t cell = static_cast<uint32_t>(
+            pos.x + (static_cast<size_t>(width) * pos.y));
+
+        uint64_t& visited = _visited[cell / 64];
+        const uint64_t mask = 1ull << (cell % 64);
+        if ((visited & mask) != 0)
+            return;
+
+        if (!gTileMap.isFree(cell)
+            && gTileMap.getTileData(cell).type != TileType::FOOD)
+            return;
+
+        visited |= mask;
+        _queue[tail++] = (cell << 2) | firstDir;
+    };
+
+    size_t tail = 0;
+    for (uint32_t dir = 0; dir < 4; dir++)
+    {
+        tryQueue(snake.pieces.front(), dir, dir, tail);
+    }
+
+    uint32_t reachable[4] = {};
+    int32_t foodDir = -1;
+
+    for (size_t next = 0; next < tail; next++)
+    {
+        const uint32_t cell = _queue[next] >> 2;
+        const uint32_t firstDir = _queue[next] & 3;
+
+        reachable[firstDir]++;
+
+        if (gTileMap.getTileData(cell).type == TileType::FOOD)
+        {
+            foodDir = static_cast<int32_t>(firstDir);
+            break;
+        }
+
+        const Vector2i pos{ static_cast<int32_t>(cell % width),
+                            static_cast<int32_t>(cell / width) };
+        for (uint32_t dir = 0; dir < 4 && tail < _queue.size(); dir++)
+        {
+            tryQueue(pos, dir, firstDir, tail);
+        }
+    }
+
+    // Only clear what was touched, the grid is as big as the map.
+    for (size_t i = 0; i < tail; i++)
+    {
+        const uint32_t cell = _queue[i] >> 2;
+        _visited[cell / 64] &= ~(1ull << (cell % 64));
+    }
+
+    uint32_t bestDir = 0;
+    for (uint32_t dir = 0; dir < 4; dir++)
+    {
+        if (BOT_DIRECTIONS[dir] == snake.direction)
+            bestDir = dir;
+    }
+
+    if (foodDir >= 0)
+    {
+        bestDir = static_cast<uint32_t>(foodDir);
+    }
+    else
+    {
+        for (uint32_t dir = 0; dir < 4; dir++)
+        {
+            if (reachable[dir] > reachable[bestDir])
+                bestDir = dir;
+        }
+    }
+
+    const Vector2i& newDirection = BOT_DIRECTIONS[bestDir];
+    if (newDirection != snake.direction)
+    {
+        gNetwork.setSnakeDirection(player.snakeId, newDirection);
+    }
+}
\ No newline at end of file
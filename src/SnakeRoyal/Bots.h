@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "Types.h"
+
+// Number of cells a bot looks at per tick, bounds the cost of each bot no
+// matter how big the arena is.
+static constexpr uint32_t BOT_SEARCH_CELLS = 2048;
+
+// Server controlled players, they steer their snakes like remote players do
+// but without a connection. Only the server runs them, clients receive the
+// directions like any other.
+class Bots
+{
+    std::vector<PlayerId> _bots;
+
+    // Search scratch data, sized once so the search does not allocate.
+    // Queue entries are (cell << 2) | first direction.
+    std::vector<uint64_t> _visited;
+    std::vector<uint32_t> _queue;
+
+public:
+    // Creates count bot players, returns how many could be created.
+    uint32_t add(uint32_t count);
+
+    // Forgets all bots, the players themselves are left alone.
+    void clear();
+
+    size_t count() const;
+
+    void update();
+
+private:
+    void updateBot(PlayerId playerId);
+};
+
+extern Bots gBots;
\ No newline at end of file
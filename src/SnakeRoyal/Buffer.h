@@ -28,6 +28,13 @@ public:
     BufferBase();
     ~BufferBase();
 
+    // Reads from memory owned by someone else, see borrow.
+    BufferBase(T* data, size_t size)
+        : BufferBase()
+    {
+        borrow(data, size);
+    }
+
     BufferBase(const BufferBase& other)
     {
         *this = other;
@@ -52,6 +59,9 @@ public:
         // Release from the other object, we can't delete it.
         other.m_buffer = nullptr;
         other.m_size = 0;
+        other.m_offset = 0;
+        other.m_capacity = 0;
+        other.m_borrowed = false;
     }
 
     BufferBase& operator=(BufferBase&& other)
@@ -64,10 +74,14 @@ public:
             m_size = other.m_size;
             m_offset = other.m_offset;
             m_capacity = other.m_capacity;
+            m_borrowed = other.m_borrowed;
 
             // Release from the other object, we can't delete it.
             other.m_buffer = nullptr;
             other.m_size = 0;
+            other.m_offset = 0;
+            other.m_capacity = 0;
+            other.m_borrowed = false;
         }
         return *this;
     }
@@ -95,6 +109,17 @@ public:
         return write(data.base(), data.size());
     }
 
+    // Uses memory owned by someone else, it is never freed and the buffer
+    // can not grow past it.
+    void borrow(T* data, size_t size)
+    {
+        purge();
+        m_buffer = data;
+        m_capacity = size;
+        m_size = size;
+        m_borrowed = true;
+    }
+
     // Just expands the buffer and returns the offset, this allows direct
     // writing.
     size_t room(size_t len);
@@ -387,6 +412,7 @@ template<typename T> void BufferBase<T>::purge()
     m_capacity = 0;
     m_buffer = nullptr;
     m_offset = 0;
+    m_borrowed = false;
 }
 
 template<typename T> T* BufferBase<T>::base() const
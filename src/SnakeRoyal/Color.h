@@ -2,7 +2,7 @@
 
 #include <stdint.h>
 #include <iterator>
-#include <windows.h>
+#include "Platform.h"
 
 #include "Config.h"
 
@@ -69,4 +69,8 @@ static constexpr Color COLOR_PLAYER_PALETTE[] = {
     COLOR_PASTEL_CYAN,    COLOR_PASTEL_YELLOW, COLOR_WHITE,
 };
 
-static_assert(MAX_PLAYERS <= std::size(COLOR_PLAYER_PALETTE));
\ No newline at end of file
+// Players beyond the palette size share colors.
+inline const Color& getPlayerColor(size_t playerId)
+{
+    return COLOR_PLAYER_PALETTE[playerId % std::size(COLOR_PLAYER_PALETTE)];
+}
\ No newline at end of file
@@ -1,15 +1,23 @@
 #pragma once
 
-static constexpr int MAX_PLAYERS = 24;
+// Arena defaults, the server can override these at startup and sends them to
+// clients when they join.
+static constexpr int MAX_PLAYERS_DEFAULT = 24;
 
-static constexpr int TILE_MAP_GRID_W = 48;
-static constexpr int TILE_MAP_GRID_H = 32;
+static constexpr int TILE_MAP_GRID_W_DEFAULT = 48;
+static constexpr int TILE_MAP_GRID_H_DEFAULT = 32;
+
+static constexpr int TILE_MAP_GRID_MAX = 16384;
 
 static constexpr int TILE_SIZE_W = 8;
 static constexpr int TILE_SIZE_H = 8;
 
-static constexpr int TILE_MAP_SIZE_W = TILE_MAP_GRID_W * (TILE_SIZE_W + 1);
-static constexpr int TILE_MAP_SIZE_H = TILE_MAP_GRID_H * (TILE_SIZE_H + 1);
+// The window layout is based on the default arena, bigger arenas are drawn
+// with smaller tiles.
+static constexpr int TILE_MAP_SIZE_W = TILE_MAP_GRID_W_DEFAULT
+                                       * (TILE_SIZE_W + 1);
+static constexpr int TILE_MAP_SIZE_H = TILE_MAP_GRID_H_DEFAULT
+                                       * (TILE_SIZE_H + 1);
 
 static constexpr int TILE_MAP_MARGIN_TOP = 30;
 static constexpr int TILE_MAP_MARGIN_BOTTOM = 60;
@@ -1,7 +1,8 @@
 #include <iostream>
-#include <windows.h>
+#include "Platform.h"
 #include <thread>
 #include <assert.h>
+#include <algorithm>
 
 #include "Logging.h"
 #include "Game.h"
@@ -10,11 +11,12 @@
 #include "Players.h"
 #include "Utils.h"
 #include "Network.h"
+#include "Bots.h"
+#include "Prediction.h"
+#include "Snapshot.h"
 
 Game gGame;
 
-static constexpr Color COLOR_FOOD = COLOR_ORANGE;
-
 void Game::setHeadless(bool headless)
 {
     _headless = headless;
@@ -33,12 +35,41 @@ void Game::init(HWND hWnd)
     _randState = static_cast<uint32_t>(time(nullptr));
     _tick = 0;
 
-    if (gNetwork.getMode() == NetworkMode::NONE)
+    // Bots can play without anyone connected.
+    if (gNetwork.getMode() == NetworkMode::NONE || gBots.count() > 0)
     {
         restart(GAME_ROUND_RESTART_TICKS);
     }
 }
 
+bool Game::setArena(const ArenaConfig_t& arena)
+{
+    if (arena.width <= 0 || arena.width > TILE_MAP_GRID_MAX)
+        return false;
+    if (arena.height <= 0 || arena.height > TILE_MAP_GRID_MAX)
+        return false;
+    if (arena.maxPlayers == 0 || arena.maxPlayers >= INVALID_PLAYER_ID)
+        return false;
+
+    logPrint(
+        "%s(%d, %d, %u)\n", __FUNCTION__, arena.width, arena.height,
+        arena.maxPlayers);
+
+    _arena = arena;
+
+    gTileMap.init(arena.width, arena.height);
+    gPlayers.init(arena.maxPlayers);
+    gSnakes.init(arena.maxPlayers, gTileMap.getChunkCount());
+    gBots.clear();
+
+    return true;
+}
+
+const ArenaConfig_t& Game::getArena() const
+{
+    return _arena;
+}
+
 void Game::restart(uint32_t delayInTicks)
 {
     logPrint("%s\n", __FUNCTION__);
@@ -48,9 +79,8 @@ void Game::restart(uint32_t delayInTicks)
     if (gNetwork.getMode() == NetworkMode::SERVER)
     {
         MessageServerRoundRestart msgRoundRestart;
-        msgRoundRestart.tick = _tick;
         msgRoundRestart.delay = delayInTicks;
-        gNetwork.sendMessage(msgRoundRestart);
+        gNetwork.sendEvent(msgRoundRestart);
     }
 }
 
@@ -60,13 +90,19 @@ void Game::startRound()
 
     gTileMap.reset();
 
-    size_t playerCount = gPlayers.count();
+    const int32_t mapW = gTileMap.getWidth();
+    const int32_t mapH = gTileMap.getHeight();
 
-    int32_t spawnY = TILE_MAP_GRID_H / 2;
-    int32_t spawnSpacing = TILE_MAP_GRID_W / (playerCount + 1);
-    int32_t spawnX = spawnSpacing;
+    // Spawn in rows, each row holds up to half the map width of players.
+    const int32_t playerCount = static_cast<int32_t>(gPlayers.count());
+    const int32_t spawnColumns = std::max(
+        1, std::min(playerCount, std::max(1, mapW / 2)));
+    const int32_t spawnRows = (playerCount + spawnColumns - 1) / spawnColumns;
+    const int32_t spawnSpacingX = mapW / (spawnColumns + 1);
+    const int32_t spawnSpacingY = mapH / (spawnRows + 1);
 
-    for (PlayerId playerId = 0; playerId < MAX_PLAYERS; playerId++)
+    int32_t spawnIndex = 0;
+    for (PlayerId playerId = 0; playerId < gPlayers.capacity(); playerId++)
     {
         if (!gPlayers.isValidPlayer(playerId))
             continue;
@@ -77,8 +113,13 @@ void Game::startRound()
             gSnakes.remove(player.snakeId);
         }
 
+        const int32_t spawnX = spawnSpacingX
+                               * ((spawnIndex % spawnColumns) + 1);
+        const int32_t spawnY = spawnSpacingY
+                               * ((spawnIndex / spawnColumns) + 1);
+        spawnIndex++;
+
         SnakeId snakeId = gSnakes.create(playerId, spawnX, spawnY);
-        spawnX += spawnSpacing;
 
         gPlayers.setSnake(playerId, snakeId);
     }
@@ -94,8 +135,7 @@ void Game::startRound()
     if (gNetwork.getMode() == NetworkMode::SERVER)
     {
         MessageServerRoundStart msgRoundStart;
-        msgRoundStart.tick = _tick;
-        gNetwork.sendMessage(msgRoundStart);
+        gNetwork.sendEvent(msgRoundStart);
     }
 }
 
@@ -107,28 +147,36 @@ void Game::update()
 
     if (gNetwork.getMode() == NetworkMode::CLIENT)
     {
+        // Nothing to simulate before the first frame arrived.
+        if (gNetwork.getServerTick() == 0)
+            return;
+
         // Allow client to catch up for GAME_TICK_DELTA_THRESHOLD *
         // GAME_TICK_RATE in ms
-        numUpdates = std::min<int32_t>(
-            gNetwork.getServerTick() - _tick, GAME_TICK_DELTA_THRESHOLD);
+        const int32_t behind = static_cast<int32_t>(
+            gNetwork.getServerTick() - _tick);
+        numUpdates = std::clamp<int32_t>(behind, 1, GAME_TICK_DELTA_THRESHOLD);
     }
 
     for (int i = 0; i < numUpdates; i++)
     {
         gNetwork.update();
 
+        // Clients run ahead of the server instead of waiting for its events,
+        // they roll back to the snapshot of a tick once they arrive.
         if (gNetwork.getMode() == NetworkMode::CLIENT)
         {
-            if (_tick >= gNetwork.getServerTick())
+            const int32_t ahead = static_cast<int32_t>(
+                _tick - gNetwork.getServerTick());
+            if (ahead >= static_cast<int32_t>(SNAPSHOT_TICKS) - 1)
                 break;
-        }
 
-        if (getRoundState() == RoundState::RUNNING)
-        {
-            gPlayers.update();
-            gSnakes.update();
+            if (ahead >= 0)
+                gSnapshots.save();
         }
 
+        // Round changes are events of the tick like any other, clients apply
+        // them before they simulate it so the server has to do the same.
         if (gNetwork.getMode() == NetworkMode::SERVER)
         {
             if (getRoundState() == RoundState::RESTARTING
@@ -147,17 +195,40 @@ void Game::update()
             }
         }
 
+        if (getRoundState() == RoundState::RUNNING)
+        {
+            gPlayers.update();
+            gBots.update();
+            gSnakes.update();
+        }
+
         _tick++;
+        _tickHash = getStateHash();
 
-        if (gNetwork.getMode() == NetworkMode::CLIENT)
+        gNetwork.sendFrame();
+
+        // Ticks ahead of the server are checked once its frame arrives.
+        if (gNetwork.getMode() == NetworkMode::CLIENT
+            && _tick <= gNetwork.getServerTick())
         {
-            assert(_tick <= gNetwork.getServerTick());
+            gNetwork.checkStateHash(_tick, _tickHash);
         }
 
         gNetwork.flush();
     }
 }
 
+void Game::replayTick()
+{
+    if (getRoundState() == RoundState::RUNNING)
+    {
+        gSnakes.update();
+    }
+
+    _tick++;
+    _tickHash = getStateHash();
+}
+
 void Game::draw()
 {
     RECT rc;
@@ -166,9 +237,15 @@ void Game::draw()
     Painter painter(_hWnd, rc);
     painter.clear({ 0, 0, 0 });
 
+    // Clients draw the world ahead with their own turns applied.
+    const bool predicted = gPrediction.begin();
+
     gTileMap.draw(painter);
 
     drawInfo(painter);
+
+    if (predicted)
+        gPrediction.end();
 }
 
 void Game::drawInfo(Painter& painter)
@@ -210,6 +287,11 @@ void Game::drawInfo(Painter& painter)
         break;
     }
 
+    if (gNetwork.isDesynced())
+    {
+        strcat_s(roundInfo, ", Desync");
+    }
+
     painter.text(roundInfo, TILE_MAP_MARGIN_LEFT, 10);
 }
 
@@ -247,10 +329,9 @@ void Game::setRoundState(RoundState state, uint32_t delay /* = 0*/)
     if (gNetwork.getMode() == NetworkMode::SERVER)
     {
         MessageServerRoundState msgRoundState;
-        msgRoundState.tick = _tick;
         msgRoundState.state = state;
         msgRoundState.delay = delay;
-        gNetwork.sendMessage(msgRoundState);
+        gNetwork.sendEvent(msgRoundState);
     }
 }
 
@@ -292,18 +373,30 @@ void Game::setTick(uint32_t tick)
     _tick = tick;
 }
 
-void Game::createFood()
+uint64_t Game::getStateHash() const
 {
-    while (true)
-    {
-        int32_t x = gGame.getRand() % TILE_MAP_GRID_W;
-        int32_t y = gGame.getRand() % TILE_MAP_GRID_H;
+    uint64_t hash = gTileMap.getHash() ^ gSnakes.getHash();
 
-        const TileData_t& data = gTileMap.getTileData(x, y);
-        if (data.type != TileType::NONE)
-            continue;
+    // Tag the game fields so they can not cancel each other out.
+    hash ^= Utils::hash64((1ull << 40) | _randState);
+    hash ^= Utils::hash64(
+        (2ull << 40) | (static_cast<uint64_t>(_roundData.state) << 32)
+        | _roundData.timeout);
 
-        gTileMap.setData(x, y, TileType::FOOD, COLOR_FOOD);
-        break;
-    }
+    return hash;
+}
+
+uint64_t Game::getTickHash() const
+{
+    return _tickHash;
+}
+
+void Game::createFood()
+{
+    const uint32_t freeCount = gTileMap.getFreeCount();
+    if (freeCount == 0)
+        return;
+
+    const Vector2i pos = gTileMap.getFreeCell(getRand() % freeCount);
+    gTileMap.setData(pos.x, pos.y, TileType::FOOD, TILE_COLOR_FOOD);
 }
@@ -16,6 +16,13 @@ struct RoundData_t
     uint32_t timeout = 0;
 };
 
+struct ArenaConfig_t
+{
+    int32_t width = TILE_MAP_GRID_W_DEFAULT;
+    int32_t height = TILE_MAP_GRID_H_DEFAULT;
+    uint32_t maxPlayers = MAX_PLAYERS_DEFAULT;
+};
+
 class Game
 {
     HWND _hWnd = nullptr;
@@ -24,14 +31,27 @@ class Game
     bool _hasFocus = true;
     uint32_t _randState = 0;
     RoundData_t _roundData;
+    ArenaConfig_t _arena;
+
+    // State hash at the end of the last simulated tick.
+    uint64_t _tickHash = 0;
 
 public:
     void setHeadless(bool headless);
     bool getHeadless() const;
     void init(HWND hWnd);
+
+    // Resizes the tile map, player and snake slots, this clears the world.
+    bool setArena(const ArenaConfig_t& arena);
+    const ArenaConfig_t& getArena() const;
+
     void restart(uint32_t delayInTicks);
     void startRound();
     void update();
+
+    // Simulates the current tick once more after a rollback, only what a
+    // client simulates and without sending anything.
+    void replayTick();
     void draw();
 
     uint32_t getRandState() const;
@@ -51,6 +71,11 @@ public:
     uint32_t getTick() const;
     void setTick(uint32_t tick);
 
+    // Hash of everything that must match between server and clients, this
+    // only combines the incrementally maintained hashes.
+    uint64_t getStateHash() const;
+    uint64_t getTickHash() const;
+
     void createFood();
 
 private:
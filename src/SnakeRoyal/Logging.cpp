@@ -1,25 +1,45 @@
 #include "Logging.h"
 
+#include <stdarg.h>
+#include <stdio.h>
+
+#ifdef _WIN32
 #include <conio.h>
 #include <windows.h>
-#include <varargs.h>
+#endif
 
 Logging gLogging;
 
 Logging::Logging()
 {
+#ifdef _WIN32
     AllocConsole();
+#endif
 }
 
 Logging::~Logging()
 {
+#ifdef _WIN32
     FreeConsole();
+#endif
+}
+
+void Logging::setEnabled(bool enabled)
+{
+    _enabled = enabled;
 }
 
 void Logging::print(const char* fmt, ...)
 {
+    if (!_enabled)
+        return;
+
     va_list vl;
     va_start(vl, fmt);
+#ifdef _WIN32
     _vcprintf(fmt, vl);
+#else
+    vprintf(fmt, vl);
+#endif
     va_end(vl);
-}
+}
\ No newline at end of file
@@ -2,10 +2,14 @@
 
 class Logging
 {
+    bool _enabled = true;
+
 public:
     Logging();
     ~Logging();
 
+    void setEnabled(bool enabled);
+
     void print(const char* fmt, ...);
 };
 
@@ -9,6 +9,8 @@
 #include "Utils.h"
 #include "Logging.h"
 #include "Network.h"
+#include "ThreadPool.h"
+#include "Bots.h"
 
 // Data
 static HWND _hWnd;
@@ -82,6 +84,17 @@ static bool ProcessCommandLine(LPTSTR lpCmdLine)
         LocalFree(szArgList);
     }
 
+    ArenaConfig_t arena;
+    uint32_t numBots = 0;
+
+    // Needed before host and join, wherever it is.
+    NetworkTransport transport = NetworkTransport::TCP;
+    for (const auto& arg : args)
+    {
+        if (arg == "--udp")
+            transport = NetworkTransport::UDP;
+    }
+
     // Process
     {
         for (size_t i = 0; i < args.size(); ++i)
@@ -106,7 +119,8 @@ static bool ProcessCommandLine(LPTSTR lpCmdLine)
                     }
                 }
 
-                gNetwork.startServer(host.c_str(), port);
+                gNetwork.startServer(
+                    host.c_str(), port, NetworkBackend::SOCKETS, 0, transport);
                 i += n;
             }
             else if (args[i] == "join")
@@ -127,13 +141,57 @@ static bool ProcessCommandLine(LPTSTR lpCmdLine)
                     host = host.substr(0, portPos);
                 }
 
-                gNetwork.startClient(host.c_str(), port);
+                gNetwork.startClient(host.c_str(), port, transport);
                 ++i;
             }
             else if (args[i] == "--headless")
             {
                 gGame.setHeadless(true);
             }
+            else if (args[i] == "--width" && i + 1 < args.size())
+            {
+                arena.width = atol(args[i + 1].c_str());
+                ++i;
+            }
+            else if (args[i] == "--height" && i + 1 < args.size())
+            {
+                arena.height = atol(args[i + 1].c_str());
+                ++i;
+            }
+            else if (args[i] == "--max-players" && i + 1 < args.size())
+            {
+                arena.maxPlayers = static_cast<uint32_t>(
+                    atol(args[i + 1].c_str()));
+                ++i;
+            }
+            else if (args[i] == "--bots" && i + 1 < args.size())
+            {
+                numBots = static_cast<uint32_t>(atol(args[i + 1].c_str()));
+                ++i;
+            }
+            else if (args[i] == "--threads" && i + 1 < args.size())
+            {
+                gThreadPool.init(
+                    static_cast<size_t>(atol(args[i + 1].c_str())));
+                ++i;
+            }
+        }
+    }
+
+    // Clients receive the arena from the server.
+    if (gNetwork.getMode() != NetworkMode::CLIENT)
+    {
+        if (!gGame.setArena(arena))
+        {
+            logPrint(
+                "ERROR: Invalid arena: %d x %d, %u players\n", arena.width,
+                arena.height, arena.maxPlayers);
+            return false;
+        }
+
+        if (gBots.add(numBots) != numBots)
+        {
+            logPrint("WARNING: Only room for %zu bots\n", gBots.count());
         }
     }
 
@@ -180,6 +238,7 @@ static void Init(HINSTANCE hInstance)
 
 static void Shutdown()
 {
+    gThreadPool.shutdown();
 }
 
 static void GameLoop()
@@ -1,8 +1,16 @@
 #include "Network.h"
 #include "NetworkMessage.h"
+#include "NetworkThread.h"
 #include "Logging.h"
 #include "Utils.h"
 #include "Snakes.h"
+#include "Prediction.h"
+#include "Snapshot.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
 
 Network gNetwork;
 
@@ -13,10 +21,18 @@ Network::Network()
 
 Network::~Network()
 {
+    // Nothing may be left servicing the connections once they go away.
+    for (auto& thread : _threads)
+    {
+        thread->stop();
+    }
+
     DisposeWSA();
 }
 
-void Network::startServer(const std::string& address, uint16_t port)
+void Network::startServer(
+    const std::string& address, uint16_t port, NetworkBackend backend,
+    uint32_t threads, NetworkTransport transport)
 {
     logPrint("%s(%s, %u)\n", __FUNCTION__, address.c_str(), port);
 
@@ -25,16 +41,93 @@ void Network::startServer(const std::string& address, uint16_t port)
     _listenSocket = CreateTcpSocket();
     _listenSocket->Listen(address, port);
 
+    if (backend == NetworkBackend::RING)
+    {
+        _ring = CreateSocketRing(NETWORK_RING_ENTRIES);
+        if (_ring != nullptr)
+        {
+            _ring->QueuePoll(_listenSocket.get(), _listenSocket.get());
+        }
+        else
+        {
+            logPrint("WARNING: No socket ring available, using sockets\n");
+        }
+    }
+
+    if (_ring != nullptr && threads > 0)
+    {
+        logPrint("WARNING: Network threads need the sockets backend\n");
+    }
+    else if (threads > 0)
+    {
+        for (uint32_t i = 0; i < threads; i++)
+        {
+            auto thread = std::make_unique<NetworkThread>();
+            thread->start(i == 0 ? _listenSocket.get() : nullptr);
+            _threads.push_back(std::move(thread));
+        }
+        logPrint("Network threads: %u\n", threads);
+    }
+    else if (_ring == nullptr)
+    {
+        _poller = CreateSocketPoller();
+        _poller->Add(_listenSocket.get(), _listenSocket.get());
+    }
+
+    if (transport == NetworkTransport::UDP && _poller == nullptr)
+    {
+        logPrint("WARNING: UDP needs the sockets backend without threads\n");
+    }
+    else if (transport == NetworkTransport::UDP)
+    {
+        std::random_device random;
+        for (auto& key : _cookieKey)
+        {
+            key = (static_cast<uint64_t>(random()) << 32) | random();
+        }
+
+        _udpSocket = CreateUdpSocket();
+        if (_udpSocket->Bind(address, port)
+            && _poller->Add(_udpSocket.get(), _udpSocket.get()))
+        {
+            logPrint("Taking clients over UDP as well\n");
+        }
+        else
+        {
+            logPrint("WARNING: Unable to bind UDP port %u\n", port);
+            _udpSocket.reset();
+        }
+    }
+
     logPrint("Ready for clients...\n");
 }
 
-void Network::startClient(const std::string& address, uint16_t port)
+void Network::startClient(
+    const std::string& address, uint16_t port, NetworkTransport transport)
 {
     logPrint("%s(%s, %u)\n", __FUNCTION__, address.c_str(), port);
 
     _mode = NetworkMode::CLIENT;
 
     _serverConnection = std::make_unique<Connection>();
+
+    // Nothing to wait for, the hello goes out with the first update.
+    if (transport == NetworkTransport::UDP)
+    {
+        _udpSocket = CreateUdpSocket();
+        if (!_udpSocket->Connect(address, port))
+        {
+            logPrint("Unable to resolve host\n");
+            _udpSocket.reset();
+            _mode = NetworkMode::NONE;
+            return;
+        }
+
+        _serverConnection->channel = std::make_unique<UdpChannel>(
+            SocketAddress_t{}, Utils::getTime());
+        return;
+    }
+
     _serverConnection->sock = CreateTcpSocket();
     _serverConnection->lastStatus = _serverConnection->sock->GetStatus();
 
@@ -53,28 +146,76 @@ void Network::update()
 
 void Network::flush()
 {
-    if (_mode == NetworkMode::SERVER)
+    const uint32_t tick = gGame.getTick();
+
+    if (_mode == NetworkMode::SERVER && !_threads.empty())
+    {
+        for (auto& connection : _connections)
+        {
+            // Everything handed over before went out.
+            if (connection->ioSendBytes == 0)
+                connection->flushedTick = tick;
+
+            queueThreadSend(connection);
+        }
+        for (auto& thread : _threads)
+        {
+            thread->submit();
+        }
+    }
+    else if (_mode == NetworkMode::SERVER && _ring != nullptr)
+    {
+        for (auto& connection : _connections)
+        {
+            // Completed sends are seen here, one flush late.
+            if (getSendBacklog(connection) == 0)
+                connection->flushedTick = tick;
+
+            queueSend(connection);
+        }
+        submitRing(0);
+    }
+    else if (_mode == NetworkMode::SERVER)
     {
         for (auto& connection : _connections)
         {
             flushConnection(connection);
+
+            if (getSendBacklog(connection) == 0)
+                connection->flushedTick = tick;
         }
+        sendDatagrams();
     }
     else if (_mode == NetworkMode::CLIENT)
     {
         flushConnection(_serverConnection);
+        sendDatagrams();
     }
 }
 
 void Network::processQueue()
 {
+    // Messages from network threads are dispatched as they are taken.
+    if (!_threads.empty())
+    {
+        closeFailedConnections();
+        return;
+    }
+
     for (auto it = _connections.begin(); it != _connections.end();)
     {
         auto& connection = *it;
+        if (!connection->readable)
+        {
+            it++;
+            continue;
+        }
+        connection->readable = false;
 
-        if (!processConnection(connection))
+        if (connection->failed || !processConnection(connection))
         {
             onClientDisconnected(connection);
+            releaseConnection(connection);
             it = _connections.erase(it);
         }
         else
@@ -84,28 +225,408 @@ void Network::processQueue()
     }
 }
 
+void Network::wait(int32_t timeoutMs)
+{
+    if (_mode != NetworkMode::SERVER)
+        return;
+
+    if (!_threads.empty())
+    {
+        // Nothing to do here before the next tick.
+        if (timeoutMs > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+    }
+    else if (_ring != nullptr)
+        submitRing(timeoutMs);
+    else
+        pollSockets(timeoutMs);
+}
+
 void Network::updateServer()
 {
-    std::unique_ptr<ITcpSocket> clientSock = _listenSocket->Accept();
-    if (clientSock != nullptr)
+    if (!_threads.empty())
+        receiveThreads();
+    else if (_ring != nullptr)
+        submitRing(0);
+    else
+        pollSockets(0);
+
+    applyInputs();
+}
+
+void Network::receiveThreads()
+{
+    std::unique_ptr<NetworkInputBatch_t> batch;
+    for (auto& thread : _threads)
+    {
+        while (thread->receive(batch))
+        {
+            for (const auto& input : batch->inputs)
+            {
+                processInput(input, batch->data.data());
+            }
+            thread->recycle(batch);
+        }
+    }
+}
+
+void Network::processInput(const NetworkInput_t& input, uint8_t* data)
+{
+    Connection* connection = input.connection;
+
+    switch (input.type)
+    {
+        case NetworkInputType::CONNECTED:
+        {
+            // New connections go to the threads in turn.
+            connection->ioThread = _nextThread;
+            connection->index = _connections.size();
+            _nextThread = (_nextThread + 1) % _threads.size();
+
+            _connections.emplace_back(connection);
+            _threads[connection->ioThread]->attach(connection);
+
+            onClientConnected(_connections.back());
+            break;
+        }
+        case NetworkInputType::MESSAGES:
+        {
+            // Still on the way while the connection was dropped.
+            if (connection->failed)
+                break;
+
+            size_t processed = 0;
+            if (!processMessages(
+                    _connections[connection->index], data + input.offset,
+                    input.size, processed))
+            {
+                connection->failed = true;
+            }
+            break;
+        }
+        case NetworkInputType::DISCONNECTED:
+            connection->failed = true;
+            break;
+        case NetworkInputType::CLOSED:
+        {
+            // Only connections handed back with close are answered.
+            auto it = std::find_if(
+                _closedConnections.begin(), _closedConnections.end(),
+                [connection](const std::unique_ptr<Connection>& closed) {
+                    return closed.get() == connection;
+                });
+            assert(it != _closedConnections.end());
+            if (it == _closedConnections.end())
+                break;
+
+            _closedConnections.erase(it);
+            break;
+        }
+    }
+}
+
+// The thread of each dropped connection is told to let go of it, it is
+// destroyed once the thread answered.
+void Network::closeFailedConnections()
+{
+    for (size_t i = 0; i < _connections.size();)
+    {
+        auto& connection = _connections[i];
+        if (!connection->failed)
+        {
+            i++;
+            continue;
+        }
+
+        onClientDisconnected(connection);
+
+        _threads[connection->ioThread]->close(connection.get());
+        _closedConnections.push_back(std::move(connection));
+
+        connection = std::move(_connections.back());
+        _connections.pop_back();
+        if (i < _connections.size())
+            _connections[i]->index = i;
+    }
+}
+
+void Network::pollSockets(int32_t timeoutMs)
+{
+    _readySockets.clear();
+    _poller->Wait(timeoutMs, _readySockets);
+
+    for (const auto& ready : _readySockets)
+    {
+        if (ready.userData == _listenSocket.get())
+        {
+            acceptConnections();
+            continue;
+        }
+        if (ready.userData == _udpSocket.get())
+        {
+            receiveDatagrams();
+            continue;
+        }
+
+        auto* connection = static_cast<Connection*>(ready.userData);
+        if (ready.readable)
+            connection->readable = true;
+
+        if (ready.writable && !connection->writable)
+        {
+            connection->writable = true;
+            _poller->SetWriteInterest(
+                connection->sock.get(), connection, false);
+        }
+    }
+}
+
+void Network::submitRing(int32_t timeoutMs)
+{
+    _completions.clear();
+    _ring->Submit(timeoutMs, _completions);
+
+    for (const auto& completion : _completions)
+    {
+        if (completion.userData == _listenSocket.get())
+        {
+            acceptConnections();
+            _ring->QueuePoll(_listenSocket.get(), _listenSocket.get());
+            continue;
+        }
+
+        auto* connection = static_cast<Connection*>(completion.userData);
+        if (completion.op == SocketRingOp::RECEIVE)
+        {
+            connection->recvQueued = false;
+            connection->recvBuffer.size += completion.size;
+        }
+        else
+        {
+            connection->sendQueued = false;
+            connection->ringSendBuffer.clear();
+            connection->ringSendChunks.clear();
+            connection->ringSendBytes = 0;
+        }
+
+        if (!completion.success)
+            connection->failed = true;
+
+        connection->readable = true;
+    }
+
+    if (!_closedConnections.empty())
+    {
+        _closedConnections.erase(
+            std::remove_if(
+                _closedConnections.begin(), _closedConnections.end(),
+                [](const std::unique_ptr<Connection>& connection) {
+                    return !connection->recvQueued
+                           && !connection->sendQueued;
+                }),
+            _closedConnections.end());
+    }
+}
+
+void Network::acceptConnections()
+{
+    while (true)
     {
+        std::unique_ptr<ITcpSocket> clientSock = _listenSocket->Accept();
+        if (clientSock == nullptr)
+            break;
+
         auto connection = std::make_unique<Connection>();
         connection->playerId = INVALID_PLAYER_ID;
         connection->sock = std::move(clientSock);
 
+        if (!watchConnection(connection))
+        {
+            logPrint(
+                "Unable to watch client: %s\n",
+                getHostName(connection));
+            continue;
+        }
+
         onClientConnected(connection);
 
         _connections.push_back(std::move(connection));
     }
+}
+
+void Network::receiveDatagrams()
+{
+    const double now = Utils::getTime();
+
+    if (_datagrams.empty())
+    {
+        _datagrams.resize(NETWORK_UDP_BATCH);
+        _datagramData.resize(NETWORK_UDP_BATCH * NETWORK_UDP_PACKET_SIZE);
+    }
+
+    while (true)
+    {
+        for (size_t i = 0; i < _datagrams.size(); i++)
+        {
+            _datagrams[i].data = _datagramData.data()
+                                 + i * NETWORK_UDP_PACKET_SIZE;
+            _datagrams[i].size = NETWORK_UDP_PACKET_SIZE;
+        }
+
+        const size_t count = _udpSocket->ReceiveMany(
+            _datagrams.data(), _datagrams.size());
+        for (size_t i = 0; i < count; i++)
+        {
+            receiveDatagram(_datagrams[i], now);
+        }
+
+        if (count < _datagrams.size())
+            break;
+    }
+}
+
+void Network::receiveDatagram(const SocketDatagram_t& datagram, double now)
+{
+    if (_mode == NetworkMode::CLIENT)
+    {
+        _serverConnection->channel->processPacket(
+            datagram.data, datagram.size, now);
+        return;
+    }
+
+    Connection* connection = nullptr;
+
+    auto it = _udpConnections.find(datagram.address);
+    if (it != _udpConnections.end())
+    {
+        connection = it->second;
+    }
+    else
+    {
+        receiveConnect(datagram, now);
+        return;
+    }
+
+    // Malformed datagrams are ignored like lost ones.
+    if (connection->channel->processPacket(datagram.data, datagram.size, now))
+        connection->readable = true;
+}
+
+void Network::receiveConnect(const SocketDatagram_t& datagram, double now)
+{
+    uint64_t cookie = 0;
+    const uint8_t* message = nullptr;
+    size_t messageSize = 0;
+    if (!UdpChannel::readConnect(
+            datagram.data, datagram.size, cookie, message, messageSize))
+        return;
+
+    // Cookies of the period before are still taken, one sent just before
+    // the period ended would fail otherwise.
+    const uint64_t period = static_cast<uint64_t>(
+        now / NETWORK_UDP_COOKIE_LIFETIME);
+    if (cookie != getCookie(datagram.address, period)
+        && cookie != getCookie(datagram.address, period - 1))
+    {
+        UdpHandshake_t challenge{};
+        challenge.signature = NETWORK_UDP_CHALLENGE_SIGNATURE;
+        challenge.cookie = getCookie(datagram.address, period);
+
+        const SocketDatagram_t reply{
+            datagram.address, reinterpret_cast<uint8_t*>(&challenge),
+            sizeof(challenge) };
+        _udpSocket->SendMany(&reply, 1);
+        return;
+    }
+
+    // The connect holds the hello and nothing else.
+    MessageHeader_t header;
+    if (messageSize < sizeof(header))
+        return;
+
+    memcpy(&header, message, sizeof(header));
+    if (header.signature != NETWORK_MESSAGE_SIGNATURE
+        || header.msg != NetworkMessage::CLIENT_HELLO
+        || sizeof(header) + header.size != messageSize)
+        return;
+
+    MessageClientHello msgHello;
+    Buffer buffer(
+        const_cast<uint8_t*>(message) + sizeof(header), header.size);
+    if (!msgHello.deserialize(buffer) || msgHello.version != NETWORK_VERSION)
+        return;
+
+    // Every channel holds a player from the start, so there are never more
+    // of them than the arena has room for. A client that does not fit
+    // hears nothing and gives up.
+    if (gPlayers.count() >= gPlayers.capacity())
+        return;
+
+    auto connection = std::make_unique<Connection>();
+    connection->channel = std::make_unique<UdpChannel>(datagram.address, now);
+    _udpConnections.emplace(datagram.address, connection.get());
+
+    onClientConnected(connection);
+    onClientMessageHello(connection, msgHello);
+    _connections.push_back(std::move(connection));
+}
+
+uint64_t Network::getCookie(
+    const SocketAddress_t& address, uint64_t period) const
+{
+    uint8_t data[sizeof(period) + sizeof(address.data)];
+    memcpy(data, &period, sizeof(period));
+    memcpy(data + sizeof(period), address.data, address.size);
+
+    return Utils::sipHash(_cookieKey, data, sizeof(period) + address.size);
+}
+
+void Network::sendDatagrams()
+{
+    if (_sendDatagrams.empty())
+        return;
+
+    // What the socket does not take is lost, the channels send it again.
+    _udpSocket->SendMany(_sendDatagrams.data(), _sendDatagrams.size());
+    _sendDatagrams.clear();
+}
+
+bool Network::watchConnection(std::unique_ptr<Connection>& connection)
+{
+    if (_ring != nullptr)
+        return queueReceive(connection);
+
+    return _poller->Add(connection->sock.get(), connection.get());
+}
+
+void Network::releaseConnection(std::unique_ptr<Connection>& connection)
+{
+    if (connection->channel != nullptr)
+    {
+        _udpConnections.erase(connection->channel->getAddress());
+        return;
+    }
+
+    if (_ring == nullptr)
+    {
+        _poller->Remove(connection->sock.get());
+        return;
+    }
 
-    MessageServerTick msgTick;
-    msgTick.tick = gGame.getTick();
-    sendMessage(msgTick);
+    if (connection->recvQueued || connection->sendQueued)
+    {
+        // Shutting down makes the kernel complete what it still has.
+        connection->sock->Disconnect();
+        _closedConnections.push_back(std::move(connection));
+    }
 }
 
 void Network::updateClient()
 {
-    SocketStatus currentStatus = _serverConnection->sock->GetStatus();
+    // A channel is there right away, it closes if the server stays silent.
+    SocketStatus currentStatus = _serverConnection->channel != nullptr
+                                     ? SocketStatus::CONNECTED
+                                     : _serverConnection->sock->GetStatus();
 
     // Check current socket state against the last known to print out whats happening.
     if (_serverConnection->lastStatus != currentStatus)
@@ -138,67 +659,572 @@ void Network::updateClient()
         onDisconnected();
     }
 
-    MessageClientPing msgPing;
-    msgPing.timestamp = Utils::getTime();
-    sendMessage(msgPing);
+    // A ping would only go out once the server took the connect.
+    const bool connecting = _serverConnection->channel != nullptr
+                            && _serverConnection->channel->isConnecting();
 
-    auto itRange = _tickQueue.equal_range(gGame.getTick());
-    for (auto it = itRange.first; it != itRange.second;)
+    const double now = Utils::getTime();
+    if (!connecting && now - _lastPingTime >= NETWORK_PING_INTERVAL)
     {
-        it->second();
-        it = _tickQueue.erase(it);
-    }
-}
+        MessageClientPing msgPing;
+        msgPing.timestamp = now;
+        sendUnreliable(msgPing, _serverConnection);
 
-void Network::flushConnection(std::unique_ptr<Connection>& connection)
-{
-    auto& buffer = connection->sendBuffer;
-    if (buffer.empty())
-        return;
+        _lastPingTime = now;
+    }
 
-    connection->sock->SendData(buffer.base(), buffer.size());
-    buffer.clear();
+    runTickEvents();
 }
 
-bool Network::processConnection(std::unique_ptr<Connection>& connection)
+void Network::runTickEvents()
 {
-    uint8_t tempBuffer[NETWORK_BUFFER_SIZE]{};
-    size_t received = 0;
+    const uint32_t tick = gGame.getTick();
 
-    auto readStatus = connection->sock->ReceiveData(
-        tempBuffer, sizeof(tempBuffer), &received);
-    if (readStatus == SocketReadStatus::SUCCESS)
+    uint32_t late = 0;
+    while (!_tickEvents.empty())
     {
-        auto& buffer = connection->recvBuffer;
-        buffer.seek(0, BufferSeek::END);
-        buffer.write(tempBuffer, received);
-    }
-    else if (readStatus == SocketReadStatus::DISCONNECTED)
-    {
-        return false;
-    }
+        const TickEvent_t& event = _tickEvents.front();
+        if (event.tick > tick)
+            break;
 
-    if (!processPackets(connection))
-    {
-        return false;
+        if (event.tick < tick)
+        {
+            dropTickEvent(event);
+            late++;
+        }
+        else
+        {
+            runTickEvent(event);
+        }
+        _tickEvents.pop();
     }
 
-    return true;
+    // The state hash of the tick tells whether that mattered.
+    if (late > 0)
+        logPrint("Dropped %u events of ticks before %u\n", late, tick);
 }
 
-bool Network::processPackets(std::unique_ptr<Connection>& connection)
+void Network::runTickEvent(const TickEvent_t& event)
 {
-    auto& buffer = connection->recvBuffer;
-    buffer.seek(0);
+    switch (event.type)
+    {
+        case TickEventType::SNAKE_LIST:
+        {
+            // Replaced by a newer list already.
+            if (_snakeList.tick != event.tick)
+                break;
 
-    size_t processed = 0;
-    while (!buffer.eob())
+            for (SnakeId id = 0; id < gSnakes.capacity(); id++)
+            {
+                gSnakes.set(id, Snake{});
+            }
+            for (const Snake& snake : _snakeList.snakes)
+            {
+                if (snake.id >= gSnakes.capacity())
+                    continue;
+
+                gSnakes.set(snake.id, snake);
+            }
+            break;
+        }
+        case TickEventType::PLAYER_LIST:
+        {
+            if (_playerList.tick != event.tick)
+                break;
+
+            gPlayers.clear();
+            for (auto& playerData : _playerList.players)
+            {
+                if (playerData.id >= gPlayers.capacity())
+                    continue;
+                gPlayers.setPlayerById(playerData.id, playerData);
+            }
+            break;
+        }
+        case TickEventType::PLAYER_JOINED:
+        {
+            const Player player = _joinedPlayers.front();
+            _joinedPlayers.pop();
+
+            // Already part of a state that arrived after this was queued.
+            if (player.id >= gPlayers.capacity()
+                || gPlayers.isValidPlayer(player.id))
+                break;
+
+            gPlayers.setPlayerById(player.id, player);
+
+            // Late joiners get their snake the same way as on the server.
+            if (player.snakeId != INVALID_SNAKE_ID)
+            {
+                SnakeId snakeId = gSnakes.create(player.id, 0, 0);
+                if (snakeId != player.snakeId)
+                {
+                    logPrint(
+                        "Snake %u of player %u does not match the server\n",
+                        snakeId, player.id);
+                }
+            }
+            break;
+        }
+        case TickEventType::PLAYER_DISCONNECTED:
+        {
+            // Gone already, or never known to us. The state hash of the tick
+            // tells whether that was a desync.
+            PlayerId playerId = static_cast<PlayerId>(event.value);
+            if (!gPlayers.isValidPlayer(playerId))
+                break;
+
+            const Player& player = gPlayers.getPlayer(playerId);
+            if (player.snakeId < gSnakes.capacity())
+            {
+                gSnakes.remove(player.snakeId);
+            }
+            gPlayers.removePlayer(playerId);
+            break;
+        }
+        case TickEventType::SNAKE_DIRECTION:
+        {
+            // Same for snakes that are gone.
+            const SnakeId snakeId = static_cast<SnakeId>(event.value);
+            if (snakeId >= gSnakes.capacity()
+                || gSnakes.getData(snakeId).id == INVALID_SNAKE_ID)
+                break;
+
+            gSnakes.setDirection(snakeId, event.direction);
+            break;
+        }
+        case TickEventType::ROUND_RESTART:
+            gGame.restart(event.value);
+            break;
+        case TickEventType::ROUND_STATE:
+            gGame.setRoundState(event.state, event.value);
+            break;
+        case TickEventType::ROUND_START:
+            gGame.startRound();
+            break;
+    }
+}
+
+// Joined players are queued next to their event and have to go with it.
+void Network::dropTickEvent(const TickEvent_t& event)
+{
+    if (event.type == TickEventType::PLAYER_JOINED)
+        _joinedPlayers.pop();
+}
+
+void Network::queueChunk(
+    std::unique_ptr<Connection>& connection, const SendChunk& chunk)
+{
+    connection->sendQueue.push_back(
+        QueuedChunk_t{ chunk, connection->sendBuffer.size() });
+    connection->sendQueueBytes += chunk->size();
+}
+
+// Sends the own buffer and the queued chunks interleaved as they were
+// queued, gathered into as few calls as possible. What the socket does not
+// take stays queued for the next flush.
+void Network::flushConnection(std::unique_ptr<Connection>& connection)
+{
+    if (connection->channel != nullptr)
     {
-        MessageHeader_t header;
-        if (buffer.read(header) < sizeof(header))
+        flushChannel(connection);
+        return;
+    }
+
+    auto& buffer = connection->sendBuffer;
+    auto& queue = connection->sendQueue;
+    if (buffer.empty() && queue.empty())
+        return;
+
+    if (!connection->writable || connection->failed)
+        return;
+
+    if (connection->sock->GetStatus() != SocketStatus::CONNECTED)
+        return;
+
+    gatherSendSlices(connection);
+
+    size_t sent = connection->sock->SendDataVectored(
+        _sendSlices.data(), _sendSlices.size());
+
+    // Drop what went out, first the own bytes before a chunk then the chunk.
+    size_t bufferSent = 0;
+    while (sent > 0 && !queue.empty())
+    {
+        auto& queued = queue.front();
+
+        const size_t bufferLeft = queued.sendBufferEnd - bufferSent;
+        const size_t bufferTaken = std::min(sent, bufferLeft);
+        bufferSent += bufferTaken;
+        sent -= bufferTaken;
+        if (bufferTaken < bufferLeft)
+            break;
+
+        const size_t chunkLeft = queued.chunk->size()
+                                 - connection->sendChunkOffset;
+        const size_t chunkTaken = std::min(sent, chunkLeft);
+        connection->sendChunkOffset += chunkTaken;
+        connection->sendQueueBytes -= chunkTaken;
+        sent -= chunkTaken;
+        if (chunkTaken < chunkLeft)
+            break;
+
+        queue.pop_front();
+        connection->sendChunkOffset = 0;
+    }
+    bufferSent += sent;
+
+    if (bufferSent == buffer.size())
+    {
+        buffer.clear();
+    }
+    else if (bufferSent > 0)
+    {
+        buffer.seek(0);
+        buffer.erase(bufferSent);
+        buffer.seek(0, BufferSeek::END);
+    }
+
+    for (auto& queued : queue)
+    {
+        queued.sendBufferEnd -= std::min(queued.sendBufferEnd, bufferSent);
+    }
+
+    // The socket is full, wait until the poller says there is room again.
+    if (_poller != nullptr && (!buffer.empty() || !queue.empty()))
+    {
+        connection->writable = false;
+        _poller->SetWriteInterest(
+            connection->sock.get(), connection.get(), true);
+    }
+}
+
+// Moves everything queued into the reliable stream of the channel, its
+// packets are sent together with the ones of all other channels.
+void Network::flushChannel(std::unique_ptr<Connection>& connection)
+{
+    auto& channel = *connection->channel;
+    if (connection->failed)
+        return;
+
+    const double now = Utils::getTime();
+    if (channel.isClosed(now))
+    {
+        connection->failed = true;
+        connection->readable = true;
+        return;
+    }
+
+    if (!connection->sendBuffer.empty() || !connection->sendQueue.empty())
+    {
+        gatherSendSlices(connection);
+        for (const auto& slice : _sendSlices)
         {
+            channel.write(slice.data, slice.size);
+        }
+
+        connection->sendBuffer.clear();
+        connection->sendQueue.clear();
+        connection->sendChunkOffset = 0;
+        connection->sendQueueBytes = 0;
+    }
+
+    channel.writePackets(now, _sendDatagrams);
+}
+
+// Collects the own buffer and the queued chunks interleaved as they were
+// queued into _sendSlices.
+void Network::gatherSendSlices(std::unique_ptr<Connection>& connection)
+{
+    auto& buffer = connection->sendBuffer;
+    auto& queue = connection->sendQueue;
+
+    _sendSlices.clear();
+
+    size_t bufferStart = 0;
+    size_t chunkOffset = connection->sendChunkOffset;
+    for (const auto& queued : queue)
+    {
+        if (queued.sendBufferEnd > bufferStart)
+        {
+            _sendSlices.push_back(SocketSlice_t{
+                buffer.base() + bufferStart,
+                queued.sendBufferEnd - bufferStart });
+            bufferStart = queued.sendBufferEnd;
+        }
+        _sendSlices.push_back(SocketSlice_t{
+            queued.chunk->base() + chunkOffset,
+            queued.chunk->size() - chunkOffset });
+        chunkOffset = 0;
+    }
+    if (buffer.size() > bufferStart)
+    {
+        _sendSlices.push_back(SocketSlice_t{
+            buffer.base() + bufferStart, buffer.size() - bufferStart });
+    }
+}
+
+// Hands everything pending to the ring at once, the connection keeps the
+// buffer and chunks alive until the send completed.
+void Network::queueSend(std::unique_ptr<Connection>& connection)
+{
+    if (connection->sendQueued || connection->failed)
+        return;
+
+    if (connection->sendBuffer.empty() && connection->sendQueue.empty())
+        return;
+
+    gatherSendSlices(connection);
+
+    // The slices point to the memory, not the buffer object.
+    connection->ringSendBytes = getSendBacklog(connection);
+    std::swap(connection->sendBuffer, connection->ringSendBuffer);
+    for (auto& queued : connection->sendQueue)
+    {
+        connection->ringSendChunks.push_back(std::move(queued.chunk));
+    }
+    connection->sendQueue.clear();
+    connection->sendChunkOffset = 0;
+    connection->sendQueueBytes = 0;
+
+    if (!_ring->QueueSend(
+            connection->sock.get(), _sendSlices.data(), _sendSlices.size(),
+            connection.get()))
+    {
+        connection->failed = true;
+        connection->readable = true;
+        return;
+    }
+    connection->sendQueued = true;
+}
+
+// Hands the own buffer and the queued chunks to the thread of the
+// connection as pieces, interleaved as they were queued.
+// Swaps sendBuffer with a buffer the network thread is done with, there is
+// only a new one while all of them are still on their way.
+SendChunk Network::takeThreadSendBuffer(
+    std::unique_ptr<Connection>& connection)
+{
+    std::shared_ptr<Buffer> spare;
+    for (const auto& pooled : connection->ioSendBuffers)
+    {
+        if (pooled.use_count() == 1)
+        {
+            spare = pooled;
             break;
         }
+    }
+
+    if (spare == nullptr)
+    {
+        spare = std::make_shared<Buffer>();
+        if (connection->ioSendBuffers.size() < NETWORK_THREAD_SEND_BUFFERS)
+            connection->ioSendBuffers.push_back(spare);
+    }
+
+    // The thread is done reading it once it dropped its reference.
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    spare->clear();
+    std::swap(*spare, connection->sendBuffer);
+    return spare;
+}
+
+void Network::queueThreadSend(std::unique_ptr<Connection>& connection)
+{
+    auto& buffer = connection->sendBuffer;
+    auto& queue = connection->sendQueue;
+    if (buffer.empty() && queue.empty())
+        return;
+
+    NetworkThread& thread = *_threads[connection->ioThread];
+    connection->ioSendBytes += buffer.size() + connection->sendQueueBytes;
+
+    SendChunk own;
+    if (!buffer.empty())
+        own = takeThreadSendBuffer(connection);
+
+    size_t bufferStart = 0;
+    for (const auto& queued : queue)
+    {
+        if (queued.sendBufferEnd > bufferStart)
+        {
+            thread.send(
+                connection.get(), own, bufferStart,
+                queued.sendBufferEnd - bufferStart);
+            bufferStart = queued.sendBufferEnd;
+        }
+        thread.send(connection.get(), queued.chunk, 0, queued.chunk->size());
+    }
+    if (own != nullptr && own->size() > bufferStart)
+    {
+        thread.send(
+            connection.get(), own, bufferStart, own->size() - bufferStart);
+    }
+
+    buffer.clear();
+    queue.clear();
+    connection->sendQueueBytes = 0;
+}
+
+bool Network::queueReceive(std::unique_ptr<Connection>& connection)
+{
+    auto& recv = connection->recvBuffer;
+    reserveRecvSpace(recv);
+
+    if (!_ring->QueueReceive(
+            connection->sock.get(), recv.data.data() + recv.size,
+            recv.data.size() - recv.size, connection.get()))
+    {
+        return false;
+    }
+    connection->recvQueued = true;
+    return true;
+}
+
+void Network::reserveRecvSpace(RecvBuffer_t& recv)
+{
+    if (recv.data.size() - recv.size >= NETWORK_RECV_SPACE)
+        return;
+
+    // Only the unprocessed rest is moved, usually a partial message.
+    if (recv.readPos > 0)
+    {
+        memmove(
+            recv.data.data(), recv.data.data() + recv.readPos,
+            recv.size - recv.readPos);
+        recv.size -= recv.readPos;
+        recv.readPos = 0;
+    }
+    if (recv.data.size() - recv.size < NETWORK_RECV_SPACE)
+    {
+        recv.data.resize(recv.size + NETWORK_RECV_SPACE);
+    }
+}
+
+bool Network::processConnection(std::unique_ptr<Connection>& connection)
+{
+    if (connection->channel != nullptr)
+        return processChannel(connection);
+
+    auto& recv = connection->recvBuffer;
+
+    if (_ring != nullptr)
+    {
+        // The buffer is not touched while the kernel receives into it.
+        if (connection->recvQueued)
+            return true;
+
+        return processPackets(connection) && queueReceive(connection);
+    }
+
+    // Receive straight into the buffer until the socket has nothing left.
+    while (true)
+    {
+        reserveRecvSpace(recv);
+
+        const size_t space = recv.data.size() - recv.size;
+        size_t received = 0;
+
+        auto readStatus = connection->sock->ReceiveData(
+            recv.data.data() + recv.size, space, &received);
+        if (readStatus == SocketReadStatus::DISCONNECTED)
+        {
+            return false;
+        }
+        if (readStatus != SocketReadStatus::SUCCESS)
+        {
+            break;
+        }
+
+        recv.size += received;
+        if (received < space)
+        {
+            break;
+        }
+    }
+
+    if (!processPackets(connection))
+    {
+        return false;
+    }
+
+    return true;
+}
+
+bool Network::processChannel(std::unique_ptr<Connection>& connection)
+{
+    auto& channel = *connection->channel;
+
+    // The server received for all its channels already.
+    if (_mode == NetworkMode::CLIENT)
+        receiveDatagrams();
+
+    if (channel.isClosed(Utils::getTime()))
+        return false;
+
+    // Unreliable messages are complete in each packet, they do not wait for
+    // the stream.
+    auto& messages = channel.getReceivedMessages();
+    if (!messages.empty())
+    {
+        size_t processed = 0;
+        const bool res = processMessages(
+            connection, messages.data(), messages.size(), processed);
+        messages.clear();
+        if (!res)
+            return false;
+    }
+
+    auto& recv = connection->recvBuffer;
+    while (true)
+    {
+        reserveRecvSpace(recv);
+
+        const size_t space = recv.data.size() - recv.size;
+        const size_t received = channel.read(
+            recv.data.data() + recv.size, space);
+
+        recv.size += received;
+        if (received < space)
+            break;
+    }
+
+    return processPackets(connection);
+}
+
+bool Network::processPackets(std::unique_ptr<Connection>& connection)
+{
+    auto& recv = connection->recvBuffer;
+
+    size_t processed = 0;
+    if (!processMessages(
+            connection, recv.data.data() + recv.readPos,
+            recv.size - recv.readPos, processed))
+    {
+        return false;
+    }
+    recv.readPos += processed;
+
+    if (recv.readPos == recv.size)
+    {
+        recv.readPos = 0;
+        recv.size = 0;
+    }
+
+    return true;
+}
+
+bool Network::processMessages(
+    std::unique_ptr<Connection>& connection, uint8_t* data, size_t size,
+    size_t& processed)
+{
+    while (size - processed >= sizeof(MessageHeader_t))
+    {
+        uint8_t* message = data + processed;
+
+        MessageHeader_t header;
+        memcpy(&header, message, sizeof(header));
 
         if (header.signature != NETWORK_MESSAGE_SIGNATURE)
         {
@@ -206,12 +1232,16 @@ bool Network::processPackets(std::unique_ptr<Connection>& connection)
             return false;
         }
 
-        if (buffer.offset() + header.size > buffer.size())
+        const size_t messageEnd = sizeof(header) + header.size;
+        if (messageEnd > size - processed)
         {
             // Need more data.
             break;
         }
 
+        // The message is read in place and can not read past its end.
+        Buffer buffer(message + sizeof(header), header.size);
+
         switch (header.msg)
         {
             // Server.
@@ -231,12 +1261,17 @@ bool Network::processPackets(std::unique_ptr<Connection>& connection)
                         buffer, connection, &Network::onClientMessagePing))
                     return false;
                 break;
+            case MessageClientResync::MESSAGE_ID:
+                if (!dispatchMessage<MessageClientResync>(
+                        buffer, connection, &Network::onClientMessageResync))
+                    return false;
+                break;
             // Client
             //////////////////////////////////////////////////////////////////////////
-            case MessageServerTick::MESSAGE_ID:
-                if (!dispatchMessage<MessageServerTick>(
+            case MessageServerFrame::MESSAGE_ID:
+                if (!dispatchMessage<MessageServerFrame>(
                         buffer, _serverConnection,
-                        &Network::onServerMessageTick))
+                        &Network::onServerMessageFrame))
                     return false;
                 break;
             case MessageServerState::MESSAGE_ID:
@@ -263,34 +1298,10 @@ bool Network::processPackets(std::unique_ptr<Connection>& connection)
                         &Network::onServerMessageSnakeList))
                     return false;
                 break;
-            case MessageServerSnakeDirection::MESSAGE_ID:
-                if (!dispatchMessage<MessageServerSnakeDirection>(
-                        buffer, _serverConnection,
-                        &Network::onServerMessageSnakeDirection))
-                    return false;
-                break;
-            case MessageServerRoundRestart::MESSAGE_ID:
-                if (!dispatchMessage<MessageServerRoundRestart>(
-                        buffer, _serverConnection,
-                        &Network::onServerMessageRoundRestart))
-                    return false;
-                break;
-            case MessageServerRoundState::MESSAGE_ID:
-                if (!dispatchMessage<MessageServerRoundState>(
-                        buffer, _serverConnection,
-                        &Network::onServerMessageRoundState))
-                    return false;
-                break;
-            case MessageServerRoundStart::MESSAGE_ID:
-                if (!dispatchMessage<MessageServerRoundStart>(
-                        buffer, _serverConnection,
-                        &Network::onServerMessageRoundStart))
-                    return false;
-                break;
-            case MessageServerPlayerDisconnected::MESSAGE_ID:
-                if (!dispatchMessage<MessageServerPlayerDisconnected>(
+            case MessageServerArena::MESSAGE_ID:
+                if (!dispatchMessage<MessageServerArena>(
                         buffer, _serverConnection,
-                        &Network::onServerMessagePlayerDisconnected))
+                        &Network::onServerMessageArena))
                     return false;
                 break;
             case MessageServerPong::MESSAGE_ID:
@@ -299,19 +1310,19 @@ bool Network::processPackets(std::unique_ptr<Connection>& connection)
                         &Network::onServerMessagePong))
                     return false;
                 break;
+            case MessageServerInputAck::MESSAGE_ID:
+                if (!dispatchMessage<MessageServerInputAck>(
+                        buffer, _serverConnection,
+                        &Network::onServerMessageInputAck))
+                    return false;
+                break;
             default:
                 logPrint("Unhandled network message: %u\n", header.msg);
                 assert(false);
                 break;
         }
 
-        processed = buffer.offset();
-    }
-
-    if (processed > 0)
-    {
-        buffer.seek(0);
-        buffer.erase(processed);
+        processed += messageEnd;
     }
 
     return true;
@@ -319,16 +1330,28 @@ bool Network::processPackets(std::unique_ptr<Connection>& connection)
 
 void Network::onClientConnected(std::unique_ptr<Connection>& connection)
 {
-    logPrint("Client connected: %s\n", connection->sock->GetHostName());
+    logPrint("Client connected: %s\n", getHostName(connection));
 }
 
 void Network::onClientDisconnected(std::unique_ptr<Connection>& connection)
 {
-    logPrint("Client disconnected: %s\n", connection->sock->GetHostName());
+    logPrint("Client disconnected: %s\n", getHostName(connection));
 
     PlayerId playerId = connection->playerId;
     if (playerId != INVALID_PLAYER_ID)
     {
+        // The id can go to the next player that joins.
+        for (auto& inputs : _inputs)
+        {
+            inputs.erase(
+                std::remove_if(
+                    inputs.begin(), inputs.end(),
+                    [playerId](const QueuedInput_t& input) {
+                        return input.playerId == playerId;
+                    }),
+                inputs.end());
+        }
+
         const Player& player = gPlayers.getPlayer(playerId);
         if (player.snakeId != INVALID_SNAKE_ID)
         {
@@ -337,9 +1360,8 @@ void Network::onClientDisconnected(std::unique_ptr<Connection>& connection)
         gPlayers.removePlayer(playerId);
 
         MessageServerPlayerDisconnected msgDisconnected;
-        msgDisconnected.tick = gGame.getTick();
         msgDisconnected.playerId = playerId;
-        sendMessage(msgDisconnected);
+        sendEvent(msgDisconnected);
     }
 
     if (gPlayers.count() == 0)
@@ -351,12 +1373,32 @@ void Network::onClientDisconnected(std::unique_ptr<Connection>& connection)
 void Network::onClientMessageHello(
     std::unique_ptr<Connection>& connection, const MessageClientHello& msg)
 {
+    // Messages of other versions are laid out differently, everything after
+    // the hello would be misread.
+    if (msg.version != NETWORK_VERSION)
+    {
+        logPrint(
+            "Client version %u does not match %u, rejecting: %s\n",
+            msg.version, NETWORK_VERSION, getHostName(connection));
+        connection->failed = true;
+        connection->readable = true;
+        return;
+    }
+
     bool isFirstPlayer = gPlayers.count() == 0;
 
     SnakeId newSnakeId = INVALID_SNAKE_ID;
 
     // Create new player.
     PlayerId newPlayerId = gPlayers.createPlayer(msg.name, newSnakeId);
+    if (newPlayerId == INVALID_PLAYER_ID)
+    {
+        logPrint(
+            "Server is full, rejecting: %s\n", getHostName(connection));
+        connection->failed = true;
+        connection->readable = true;
+        return;
+    }
 
     // Create new snake.
     if (isFirstPlayer == false && gGame.getRoundState() == RoundState::RUNNING)
@@ -367,17 +1409,16 @@ void Network::onClientMessageHello(
 
     connection->playerId = newPlayerId;
 
-    // Send new player list.
+    // Send the arena dimensions first, the client sizes its world from it.
     {
-        MessageServerPlayerList msgPlayerList;
-        msgPlayerList.tick = gGame.getTick();
+        const ArenaConfig_t& arena = gGame.getArena();
 
-        for (PlayerId id = 0; id < MAX_PLAYERS; id++)
-        {
-            msgPlayerList.players[id] = gPlayers.getPlayer(id);
-        }
+        MessageServerArena msgArena;
+        msgArena.width = arena.width;
+        msgArena.height = arena.height;
+        msgArena.maxPlayers = arena.maxPlayers;
 
-        sendMessage(msgPlayerList);
+        sendMessage(msgArena, connection);
     }
 
     // Send client his local player id.
@@ -388,46 +1429,272 @@ void Network::onClientMessageHello(
         sendMessage(msgPlayerId, connection);
     }
 
-    // Send current state to client.
+    // Everyone else only needs the new player, the rest of their state is
+    // the same as ours. Sent first so the state of the new client has it.
+    {
+        MessageServerPlayerJoined msgPlayerJoined;
+        msgPlayerJoined.player = gPlayers.getPlayer(newPlayerId);
+
+        sendEvent(msgPlayerJoined);
+    }
+
+    sendState(connection);
+
+    // Restart round, if its already restarting it resets the timeout.
+    if (isFirstPlayer || gGame.getRoundState() == RoundState::RESTARTING)
+    {
+        gGame.restart(GAME_ROUND_RESTART_TICKS);
+    }
+}
+
+void Network::sendState(std::unique_ptr<Connection>& connection)
+{
+    const uint32_t tick = gGame.getTick();
+
+    // Free player slots are not sent.
+    {
+        MessageServerPlayerList msgPlayerList;
+        msgPlayerList.tick = tick;
+
+        for (PlayerId id = 0; id < gPlayers.capacity(); id++)
+        {
+            if (gPlayers.isValidPlayer(id))
+                msgPlayerList.players.push_back(gPlayers.getPlayer(id));
+        }
+
+        sendMessage(msgPlayerList, connection);
+    }
+
+    // Empty cells are not sent.
     {
         MessageServerState msgServerState;
         msgServerState.randState = gGame.getRandState();
-        msgServerState.tick = gGame.getTick();
-        msgServerState.tiles = gTileMap.getData();
+        msgServerState.tick = tick;
+        gTileMap.getRuns(msgServerState.tileRuns, msgServerState.tiles);
         msgServerState.roundData = gGame.getRoundData();
 
         sendMessage(msgServerState, connection);
     }
 
-    // Send all snakes to client.
+    // Free snake slots are not sent.
     {
         MessageServerSnakeList msgServerSnakeList;
-        msgServerSnakeList.tick = gGame.getTick();
-        msgServerSnakeList.snakes = gSnakes.getSnakes();
-        sendMessage(msgServerSnakeList);
+        msgServerSnakeList.tick = tick;
+        msgServerSnakeList.width = gTileMap.getWidth();
+        msgServerSnakeList.height = gTileMap.getHeight();
+
+        for (const Snake& snake : gSnakes.getSnakes())
+        {
+            if (snake.id != INVALID_SNAKE_ID)
+                msgServerSnakeList.snakes.push_back(snake);
+        }
+
+        sendMessage(msgServerSnakeList, connection);
     }
 
-    // Restart round, if its already restarting it resets the timeout.
-    if (isFirstPlayer || gGame.getRoundState() == RoundState::RESTARTING)
+    connection->syncTick = tick;
+    connection->flushedTick = tick;
+    connection->frameStart = _frameEvents.size();
+}
+
+size_t Network::getSendBacklog(
+    const std::unique_ptr<Connection>& connection) const
+{
+    size_t backlog = connection->sendBuffer.size()
+                     + connection->sendQueueBytes + connection->ringSendBytes
+                     + connection->ioSendBytes;
+    if (connection->channel != nullptr)
+        backlog += connection->channel->getBacklog();
+    return backlog;
+}
+
+const char* Network::getHostName(
+    const std::unique_ptr<Connection>& connection) const
+{
+    if (connection->channel != nullptr)
+        return connection->channel->getHostName();
+    return connection->sock->GetHostName();
+}
+
+void Network::disconnect(std::unique_ptr<Connection>& connection)
+{
+    if (connection->channel != nullptr)
+        connection->channel->close();
+    else
+        connection->sock->Disconnect();
+}
+
+bool Network::checkBacklog(std::unique_ptr<Connection>& connection)
+{
+    // Everything is sent by the flush after each tick, anything older
+    // means the client does not keep up.
+    const uint32_t behind = gGame.getTick() - connection->flushedTick;
+    if (behind <= 1)
     {
-        gGame.restart(GAME_ROUND_RESTART_TICKS);
+        if (!connection->stalled)
+            return true;
+
+        // Everything held back is covered by the state.
+        logPrint(
+            "Client caught up: %s, sending state\n",
+            getHostName(connection));
+
+        connection->stalled = false;
+        sendState(connection);
+        connection->frameStart = 0;
+        return false;
+    }
+
+    const size_t backlog = getSendBacklog(connection);
+    if (backlog > NETWORK_BACKLOG_MAX || behind > NETWORK_STALL_TICKS)
+    {
+        logPrint(
+            "Client too slow: %s, %zu bytes behind\n",
+            getHostName(connection), backlog);
+
+        connection->failed = true;
+        connection->readable = true;
+        return false;
+    }
+
+    if (!connection->stalled && behind > NETWORK_BACKLOG_TICKS)
+    {
+        logPrint(
+            "Client falling behind: %s, holding back frames\n",
+            getHostName(connection));
+
+        connection->stalled = true;
+    }
+    return !connection->stalled;
+}
+
+void Network::sendFrame()
+{
+    if (_mode != NetworkMode::SERVER)
+        return;
+
+    MessageServerFrame msgFrame;
+    msgFrame.tick = gGame.getTick();
+    msgFrame.stateHash = gGame.getTickHash();
+
+    // Most clients get all events, their frame is serialized only once.
+    SendChunk fullFrame;
+
+    for (auto& connection : _connections)
+    {
+        // Nothing to apply the events to before the state was sent.
+        if (connection->playerId == INVALID_PLAYER_ID)
+            continue;
+
+        const size_t start = connection->frameStart;
+        connection->frameStart = 0;
+
+        if (!checkBacklog(connection))
+            continue;
+
+        if (start == 0)
+        {
+            if (fullFrame == nullptr)
+            {
+                msgFrame.setEvents(_frameEvents, 0);
+
+                auto chunk = std::make_shared<Buffer>();
+                writeMessage(msgFrame, *chunk);
+                fullFrame = std::move(chunk);
+            }
+            queueChunk(connection, fullFrame);
+        }
+        else
+        {
+            msgFrame.setEvents(_frameEvents, start);
+            sendMessage(msgFrame, connection);
+        }
     }
+
+    _frameEvents.clear();
 }
 
 void Network::onClientSnakeDirection(
     std::unique_ptr<Connection>& connection,
     const MessageClientSnakeDirection& msg)
 {
+    // Inputs can arrive before the player joined or got a snake.
+    if (connection->playerId == INVALID_PLAYER_ID)
+        return;
+
     const Player& player = gPlayers.getPlayer(connection->playerId);
+    if (player.snakeId == INVALID_SNAKE_ID)
+        return;
+
+    // Anything held back for this tick goes first, inputs stay in order.
+    applyInputs();
+
+    const uint32_t tick = gGame.getTick();
+    const QueuedInput_t input{ connection->playerId, msg.newDirection };
+
+    // Late inputs are applied right away, the ack tells the client by how
+    // much it missed.
+    uint32_t applyTick = tick;
+    if (static_cast<int32_t>(msg.tick - tick) > 0)
+    {
+        applyTick = tick + std::min(msg.tick - tick, NETWORK_INPUT_TICKS - 1);
+        _inputs[applyTick % _inputs.size()].push_back(input);
+    }
+    else
+    {
+        applyInput(input);
+    }
+
+    MessageServerInputAck msgAck;
+    msgAck.sequence = msg.sequence;
+    msgAck.tick = applyTick;
+    msgAck.receivedTick = tick;
+    sendUnreliable(msgAck, connection);
+}
+
+void Network::applyInputs()
+{
+    const uint32_t tick = gGame.getTick();
+    if (tick == _inputTick)
+        return;
+
+    const uint32_t count = std::min(tick - _inputTick, NETWORK_INPUT_TICKS);
+    for (uint32_t i = count; i > 0; i--)
+    {
+        auto& inputs = _inputs[(tick - i + 1) % _inputs.size()];
+        for (const QueuedInput_t& input : inputs)
+        {
+            applyInput(input);
+        }
+        inputs.clear();
+    }
+    _inputTick = tick;
+}
+
+void Network::applyInput(const QueuedInput_t& input)
+{
+    if (!gPlayers.isValidPlayer(input.playerId))
+        return;
+
+    const Player& player = gPlayers.getPlayer(input.playerId);
+    if (player.snakeId == INVALID_SNAKE_ID)
+        return;
+
+    setSnakeDirection(player.snakeId, input.direction);
+}
+
+void Network::setSnakeDirection(SnakeId snakeId, const Vector2i& newDirection)
+{
+    gSnakes.setDirection(snakeId, newDirection);
 
-    gSnakes.setDirection(player.snakeId, msg.newDirection);
+    if (_mode != NetworkMode::SERVER)
+        return;
 
     MessageServerSnakeDirection msgSnakeDir;
-    msgSnakeDir.tick = gGame.getTick();
-    msgSnakeDir.snakeId = player.snakeId;
-    msgSnakeDir.newDirection = msg.newDirection;
+    msgSnakeDir.snakeId = snakeId;
+    msgSnakeDir.newDirection = newDirection;
 
-    sendMessage(msgSnakeDir);
+    sendEvent(msgSnakeDir);
 }
 
 void Network::onClientMessagePing(
@@ -435,7 +1702,22 @@ void Network::onClientMessagePing(
 {
     MessageServerPong msgPong;
     msgPong.timestamp = msg.timestamp;
-    sendMessage(msgPong, connection);
+    sendUnreliable(msgPong, connection);
+}
+
+void Network::onClientMessageResync(
+    std::unique_ptr<Connection>& connection, const MessageClientResync& msg)
+{
+    // Stalled clients get the state once they caught up anyway.
+    if (connection->playerId == INVALID_PLAYER_ID
+        || msg.tick <= connection->syncTick || connection->stalled)
+        return;
+
+    logPrint(
+        "Resync for %s at tick %u\n", getHostName(connection),
+        msg.tick);
+
+    sendState(connection);
 }
 
 void Network::onConnected()
@@ -446,6 +1728,16 @@ void Network::onConnected()
     msg.version = NETWORK_VERSION;
     Utils::getUsername(msg.name, sizeof(msg.name));
 
+    // Over UDP the hello opens the channel.
+    if (_serverConnection->channel != nullptr)
+    {
+        _messageBuffer.clear();
+        writeMessage(msg, _messageBuffer);
+        _serverConnection->channel->connect(
+            _messageBuffer.base(), _messageBuffer.size(), Utils::getTime());
+        return;
+    }
+
     sendMessage(msg, _serverConnection);
 }
 
@@ -454,14 +1746,193 @@ void Network::onDisconnected()
     logPrint("Disconnected.\n");
 
     _mode = NetworkMode::NONE;
-    _tickQueue.clear();
+    _tickEvents.clear();
+    _joinedPlayers.clear();
     _serverTick = 0;
+    _stateHashes.fill(TickHash_t{});
+    _desync = false;
+
+    gPrediction.reset();
+    gSnapshots.clear();
 }
 
-void Network::onServerMessageTick(
-    std::unique_ptr<Connection>& serverConnection, const MessageServerTick& msg)
+void Network::onServerMessageFrame(
+    std::unique_ptr<Connection>& serverConnection, MessageServerFrame& msg)
 {
+    // The events belong to the tick that ended with this frame.
+    const uint32_t tick = msg.tick - 1;
+    const size_t queued = _tickEvents.size();
+
+    Buffer& events = msg.events;
+    events.seek(0);
+    while (!events.eob())
+    {
+        VarUInt id;
+        VarUInt size;
+        if (!Serializer<VarUInt>::deserialize(events, id)
+            || !Serializer<VarUInt>::deserialize(events, size)
+            || events.offset() + size.value > events.size())
+        {
+            logPrint("Invalid frame from server\n");
+            disconnect(serverConnection);
+            return;
+        }
+
+        const size_t end = events.offset() + size.value;
+
+        bool res = true;
+        switch (id.value)
+        {
+            case MessageServerPlayerJoined::MESSAGE_ID:
+                res = dispatchEvent<MessageServerPlayerJoined>(
+                    events, tick, &Network::onServerEventPlayerJoined);
+                break;
+            case MessageServerPlayerDisconnected::MESSAGE_ID:
+                res = dispatchEvent<MessageServerPlayerDisconnected>(
+                    events, tick, &Network::onServerEventPlayerDisconnected);
+                break;
+            case MessageServerSnakeDirection::MESSAGE_ID:
+                res = dispatchEvent<MessageServerSnakeDirection>(
+                    events, tick, &Network::onServerEventSnakeDirection);
+                break;
+            case MessageServerRoundRestart::MESSAGE_ID:
+                res = dispatchEvent<MessageServerRoundRestart>(
+                    events, tick, &Network::onServerEventRoundRestart);
+                break;
+            case MessageServerRoundState::MESSAGE_ID:
+                res = dispatchEvent<MessageServerRoundState>(
+                    events, tick, &Network::onServerEventRoundState);
+                break;
+            case MessageServerRoundStart::MESSAGE_ID:
+                res = dispatchEvent<MessageServerRoundStart>(
+                    events, tick, &Network::onServerEventRoundStart);
+                break;
+            default:
+                logPrint("Unhandled frame event: %u\n", id.value);
+                assert(false);
+                break;
+        }
+
+        if (!res || events.offset() > end)
+        {
+            logPrint("Invalid frame event: %u\n", id.value);
+            disconnect(serverConnection);
+            return;
+        }
+
+        events.seek(end);
+    }
+
     _serverTick = msg.tick;
+
+    TickHash_t& entry = _stateHashes[msg.tick % _stateHashes.size()];
+    entry.tick = msg.tick;
+    entry.hash = msg.stateHash;
+
+    // Ticks simulated ahead without these events are simulated again with
+    // them, otherwise the tick is checked now that its hash is known.
+    const uint32_t present = gGame.getTick();
+    if (present > tick && _tickEvents.size() > queued)
+    {
+        rollback(tick);
+    }
+    else if (present > msg.tick)
+    {
+        uint64_t hash;
+        if (gSnapshots.getHash(msg.tick, hash))
+            checkStateHash(msg.tick, hash);
+    }
+    else if (present == msg.tick)
+    {
+        checkStateHash(msg.tick, gGame.getTickHash());
+    }
+}
+
+void Network::rollback(uint32_t tick)
+{
+    const uint32_t present = gGame.getTick();
+
+    // Too far back, the events are dropped as late and the state hash
+    // tells whether that matters.
+    if (!gSnapshots.restore(tick))
+        return;
+
+    while (gGame.getTick() < present)
+    {
+        if (gGame.getTick() >= _serverTick)
+            gSnapshots.save();
+
+        runTickEvents();
+        gGame.replayTick();
+
+        if (gGame.getTick() <= _serverTick)
+            checkStateHash(gGame.getTick(), gGame.getTickHash());
+    }
+}
+
+bool Network::checkStateHash(uint32_t tick, uint64_t hash)
+{
+    const TickHash_t& entry = _stateHashes[tick % _stateHashes.size()];
+    if (entry.tick != tick || entry.hash == hash)
+        return true;
+
+    if (!_desync)
+    {
+        logPrint(
+            "Desync at tick %u, server %016llx, client %016llx\n", tick,
+            static_cast<unsigned long long>(entry.hash),
+            static_cast<unsigned long long>(hash));
+
+        _desyncCount++;
+    }
+
+    requestResync(tick);
+    return false;
+}
+
+void Network::requestResync(uint32_t tick)
+{
+    if (_desync)
+        return;
+
+    MessageClientResync msgResync;
+    msgResync.tick = tick;
+    sendMessage(msgResync, _serverConnection);
+
+    _desync = true;
+}
+
+void Network::queueTickEvent(const TickEvent_t& event)
+{
+    if (!_tickEvents.push(event))
+        dropTickEvents(event.tick);
+}
+
+void Network::queueJoinedPlayer(const Player& player, const TickEvent_t& event)
+{
+    if (!_joinedPlayers.push(player))
+    {
+        dropTickEvents(event.tick);
+        return;
+    }
+    queueTickEvent(event);
+}
+
+// The state of the server replaces whatever the events would have done.
+void Network::dropTickEvents(uint32_t tick)
+{
+    if (!_desync)
+    {
+        logPrint(
+            "Too many events pending at tick %u, asking for a resync\n",
+            tick);
+
+        _desyncCount++;
+    }
+
+    _tickEvents.clear();
+    _joinedPlayers.clear();
+    requestResync(_serverTick);
 }
 
 void Network::onServerMessagePlayerLocalId(
@@ -475,89 +1946,156 @@ void Network::onServerMessageSnakeList(
     std::unique_ptr<Connection>& serverConnection,
     const MessageServerSnakeList& msg)
 {
-    _tickQueue.emplace(msg.tick, [msg]() -> void {
-        for (SnakeId id = 0; id < msg.snakes.size(); id++)
-        {
-            const Snake& newData = msg.snakes[id];
+    if (msg.width != gTileMap.getWidth() || msg.height != gTileMap.getHeight())
+    {
+        logPrint("Server snakes do not match the arena size\n");
+        disconnect(serverConnection);
+        return;
+    }
 
-            Snake& curData = gSnakes.getData(id);
-            curData = newData;
-        }
-    });
+    // Copied over the previous list, which keeps its storage.
+    _snakeList.tick = msg.tick;
+    _snakeList.snakes = msg.snakes;
+
+    TickEvent_t event;
+    event.tick = msg.tick;
+    event.type = TickEventType::SNAKE_LIST;
+    queueTickEvent(event);
 }
 
 void Network::onServerMessagePlayerList(
     std::unique_ptr<Connection>& serverConnection,
     const MessageServerPlayerList& msg)
 {
-    _tickQueue.emplace(msg.tick, [msg]() -> void {
-        PlayerId id = 0;
-        for (auto& playerData : msg.players)
-        {
-            gPlayers.setPlayerById(id, playerData);
-            id++;
-        }
-    });
+    _playerList.tick = msg.tick;
+    _playerList.players = msg.players;
+
+    TickEvent_t event;
+    event.tick = msg.tick;
+    event.type = TickEventType::PLAYER_LIST;
+    queueTickEvent(event);
+}
+
+bool Network::onServerEventPlayerJoined(
+    uint32_t tick, const MessageServerPlayerJoined& msg)
+{
+    if (msg.player.id >= gPlayers.capacity())
+        return false;
+
+    TickEvent_t event;
+    event.tick = tick;
+    event.type = TickEventType::PLAYER_JOINED;
+    queueJoinedPlayer(msg.player, event);
+    return true;
+}
+
+void Network::onServerMessageArena(
+    std::unique_ptr<Connection>& serverConnection,
+    const MessageServerArena& msg)
+{
+    ArenaConfig_t arena;
+    arena.width = msg.width;
+    arena.height = msg.height;
+    arena.maxPlayers = msg.maxPlayers;
+
+    if (!gGame.setArena(arena))
+    {
+        logPrint("Invalid arena from server\n");
+        disconnect(serverConnection);
+        return;
+    }
+
+    // All players can join in the same frame.
+    _tickEvents = RingBuffer<TickEvent_t>(
+        SNAPSHOT_TICKS * (NETWORK_FRAME_EVENTS + arena.maxPlayers));
+    _joinedPlayers = RingBuffer<Player>(
+        NETWORK_JOINED_PLAYERS + arena.maxPlayers);
 }
 
 void Network::onServerMessageState(
     std::unique_ptr<Connection>& serverConnection,
     const MessageServerState& msg)
 {
-    gTileMap.getData() = msg.tiles;
+    if (!gTileMap.setRuns(msg.tileRuns, msg.tiles))
+    {
+        logPrint("Server state does not match the arena size\n");
+        disconnect(serverConnection);
+        return;
+    }
     gGame.setTick(msg.tick);
     gGame.setRandState(msg.randState);
     gGame.getRoundData() = msg.roundData;
+    gSnapshots.clear();
+
+    // Events before the tick are part of the state already.
+    while (!_tickEvents.empty() && _tickEvents.front().tick < msg.tick)
+    {
+        dropTickEvent(_tickEvents.front());
+        _tickEvents.pop();
+    }
+    _desync = false;
 }
 
-void Network::onServerMessageSnakeDirection(
-    std::unique_ptr<Connection>& serverConnection,
-    const MessageServerSnakeDirection& msg)
+bool Network::onServerEventSnakeDirection(
+    uint32_t tick, const MessageServerSnakeDirection& msg)
 {
-    _tickQueue.emplace(msg.tick, [msg]() -> void {
-        gSnakes.setDirection(msg.snakeId, msg.newDirection);
-    });
+    if (msg.snakeId >= gSnakes.capacity())
+        return false;
+
+    TickEvent_t event;
+    event.tick = tick;
+    event.type = TickEventType::SNAKE_DIRECTION;
+    event.value = msg.snakeId;
+    event.direction = msg.newDirection;
+    queueTickEvent(event);
+    return true;
 }
 
-void Network::onServerMessageRoundRestart(
-    std::unique_ptr<Connection>& serverConnection,
-    const MessageServerRoundRestart& msg)
+bool Network::onServerEventRoundRestart(
+    uint32_t tick, const MessageServerRoundRestart& msg)
 {
-    _tickQueue.emplace(msg.tick, [msg]() -> void { gGame.restart(msg.delay); });
+    TickEvent_t event;
+    event.tick = tick;
+    event.type = TickEventType::ROUND_RESTART;
+    event.value = msg.delay;
+    queueTickEvent(event);
+    return true;
 }
 
-void Network::onServerMessageRoundState(
-    std::unique_ptr<Connection>& serverConnection,
-    const MessageServerRoundState& msg)
+bool Network::onServerEventRoundState(
+    uint32_t tick, const MessageServerRoundState& msg)
 {
-    _tickQueue.emplace(msg.tick, [msg]() -> void {
-        gGame.setRoundState(msg.state, msg.delay);
-    });
+    TickEvent_t event;
+    event.tick = tick;
+    event.type = TickEventType::ROUND_STATE;
+    event.state = msg.state;
+    event.value = msg.delay;
+    queueTickEvent(event);
+    return true;
 }
 
-void Network::onServerMessagePlayerDisconnected(
-    std::unique_ptr<Connection>& serverConnection,
-    const MessageServerPlayerDisconnected& msg)
+bool Network::onServerEventPlayerDisconnected(
+    uint32_t tick, const MessageServerPlayerDisconnected& msg)
 {
-    _tickQueue.emplace(msg.tick, [msg]() -> void {
-        PlayerId playerId = msg.playerId;
-        if (playerId != INVALID_PLAYER_ID)
-        {
-            const Player& player = gPlayers.getPlayer(playerId);
-            if (player.snakeId != INVALID_SNAKE_ID)
-            {
-                gSnakes.remove(player.snakeId);
-            }
-            gPlayers.removePlayer(playerId);
-        }
-    });
+    if (msg.playerId >= gPlayers.capacity())
+        return false;
+
+    TickEvent_t event;
+    event.tick = tick;
+    event.type = TickEventType::PLAYER_DISCONNECTED;
+    event.value = msg.playerId;
+    queueTickEvent(event);
+    return true;
 }
 
-void Network::onServerMessageRoundStart(
-    std::unique_ptr<Connection>& serverConnection,
-    const MessageServerRoundStart& msg)
+bool Network::onServerEventRoundStart(
+    uint32_t tick, const MessageServerRoundStart& msg)
 {
-    _tickQueue.emplace(msg.tick, [msg]() -> void { gGame.startRound(); });
+    TickEvent_t event;
+    event.tick = tick;
+    event.type = TickEventType::ROUND_START;
+    queueTickEvent(event);
+    return true;
 }
 
 void Network::onServerMessagePong(
@@ -568,3 +2106,10 @@ void Network::onServerMessagePong(
 
     _currentPing = static_cast<uint32_t>(delta * 1000.0);
 }
+
+void Network::onServerMessageInputAck(
+    std::unique_ptr<Connection>& serverConnection,
+    const MessageServerInputAck& msg)
+{
+    gPrediction.onInputAck(msg.sequence, msg.tick, msg.receivedTick);
+}
@@ -4,9 +4,14 @@
 #include "NetworkMessage.h"
 #include "Game.h"
 #include "Buffer.h"
+#include "UdpChannel.h"
+#include "RingBuffer.h"
+#include "Snapshot.h"
 
 #include <map>
-#include <functional>
+#include <array>
+#include <atomic>
+#include <deque>
 
 enum class NetworkMode
 {
@@ -15,27 +20,302 @@ enum class NetworkMode
     SERVER,
 };
 
+// How the server talks to its sockets.
+enum class NetworkBackend
+{
+    // Non-blocking calls on the sockets the poller reports as ready.
+    SOCKETS = 0,
+    // Receives and sends of all connections are batched through a socket
+    // ring, only where CreateSocketRing has one.
+    RING,
+};
+
+// What clients connect with.
+enum class NetworkTransport
+{
+    TCP = 0,
+    // Datagrams with acknowledgements, lost ones only hold back what they
+    // carried instead of everything after them. See UdpChannel.
+    UDP,
+};
+
 static constexpr const char* NETWORK_DEFAULT_HOST = "0.0.0.0";
 static constexpr uint16_t NETWORK_DEFAULT_PORT = 11754;
-static constexpr size_t NETWORK_BUFFER_SIZE = 1024 * 64;
+// Free space made at the end of the receive buffer before each receive.
+static constexpr size_t NETWORK_RECV_SPACE = 1024 * 4;
+
+// A client that still has data waiting after this many ticks gets no more
+// frames until it caught up, it then receives the full state instead.
+static constexpr uint32_t NETWORK_BACKLOG_TICKS = 40;
+
+// Clients still behind after this many ticks or with more bytes waiting
+// than NETWORK_BACKLOG_MAX are disconnected.
+static constexpr uint32_t NETWORK_STALL_TICKS = 400;
+static constexpr size_t NETWORK_BACKLOG_MAX = 1024 * 1024 * 16;
+
+// Size of the ring submission queue, more is submitted in several calls.
+static constexpr uint32_t NETWORK_RING_ENTRIES = 4096;
+
+// Batches queued in each direction between the simulation and a network
+// thread, more waits in the batch being filled until there is room.
+static constexpr size_t NETWORK_THREAD_QUEUE = 256;
+
+// Send buffers of a connection kept for its network thread, see
+// Connection::ioSendBuffers. More in flight than that are not kept.
+static constexpr size_t NETWORK_THREAD_SEND_BUFFERS = 4;
+
+// How soon a network thread tries again to hand over input the queue had
+// no room for.
+static constexpr int32_t NETWORK_THREAD_RETRY_MS = 1;
+
+// Datagrams taken from the UDP socket with one call.
+static constexpr size_t NETWORK_UDP_BATCH = 64;
+
+// Seconds a cookie sent with a challenge is good for at least, and at most
+// twice as long. See UdpHandshake_t.
+static constexpr double NETWORK_UDP_COOKIE_LIFETIME = 10.0;
+
+// Seconds between pings of a client.
+static constexpr double NETWORK_PING_INTERVAL = 0.1;
+
+// Ticks ahead the server holds client inputs for, inputs meant for later
+// ticks are applied at the last one of them.
+static constexpr uint32_t NETWORK_INPUT_TICKS = 32;
+
+// Number of server state hashes kept around for clients that are behind.
+static constexpr size_t NETWORK_STATE_HASH_HISTORY = 64;
+
+// Client input held back by the server until its tick.
+struct QueuedInput_t
+{
+    PlayerId playerId;
+    Vector2i direction;
+};
+
+struct TickHash_t
+{
+    uint32_t tick = 0;
+    uint64_t hash = 0;
+};
+
+// Events a client keeps queued at most, enough for SNAPSHOT_TICKS frames in
+// which every player joins or turns once, plus NETWORK_FRAME_EVENTS more.
+// More than that and the client drops them all and asks for a resync, see
+// queueTickEvent. Sized once the arena is known.
+static constexpr size_t NETWORK_FRAME_EVENTS = 512;
+static constexpr size_t NETWORK_TICK_EVENTS = SNAPSHOT_TICKS
+                                              * NETWORK_FRAME_EVENTS;
+
+// Players joined in the queued events at most besides one per player of the
+// arena, the same applies.
+static constexpr size_t NETWORK_JOINED_PLAYERS = 256;
+
+enum class TickEventType : uint8_t
+{
+    SNAKE_LIST = 0,
+    PLAYER_LIST,
+    PLAYER_JOINED,
+    PLAYER_DISCONNECTED,
+    SNAKE_DIRECTION,
+    ROUND_RESTART,
+    ROUND_STATE,
+    ROUND_START,
+};
+
+// Server event to run on the client once it reaches the tick. Joined players
+// wait in a queue of their own in the same order, the lists are kept once.
+struct TickEvent_t
+{
+    uint32_t tick = 0;
+    TickEventType type = TickEventType::ROUND_START;
+    RoundState state = RoundState::IDLE;
+
+    // Snake or player id, or the delay of round changes.
+    uint32_t value = 0;
+    Vector2i direction{};
+};
+
+// Serialized messages shared by every connection they are broadcast to,
+// never changed once queued.
+using SendChunk = std::shared_ptr<const Buffer>;
+
+struct QueuedChunk_t
+{
+    SendChunk chunk;
+
+    // Bytes of Connection::sendBuffer that go out before the chunk.
+    size_t sendBufferEnd;
+};
+
+// Part of a chunk, the simulation hands everything it sends to a network
+// thread like this.
+struct SendPiece_t
+{
+    SendChunk chunk;
+    size_t offset;
+    size_t size;
+};
+
+// Received bytes not processed yet are between readPos and size. Bytes are
+// received straight to the end, processed ones are only moved out of the
+// way when the space at the end runs out.
+struct RecvBuffer_t
+{
+    std::vector<uint8_t> data;
+    size_t readPos = 0;
+    size_t size = 0;
+};
+
+// Only touched by the network thread a connection was handed to, see
+// NetworkThread.
+struct ConnectionIO_t
+{
+    // Position in the connection list of the thread.
+    size_t index = 0;
+
+    bool readable = false;
+    bool writable = true;
+
+    // Already in the list of connections to flush.
+    bool flushQueued = false;
+
+    // The socket closed or failed, or the thread let go of the connection.
+    bool failed = false;
+
+    // Sent in order, the first piece shrinks as it goes out.
+    std::deque<SendPiece_t> sendPieces;
+};
 
 struct Connection
 {
     std::unique_ptr<ITcpSocket> sock;
+
+    // Set instead of the socket for UDP clients, everything goes through
+    // the UDP socket of Network.
+    std::unique_ptr<UdpChannel> channel;
+
     SocketStatus lastStatus = SocketStatus::CLOSED;
     PlayerId playerId = INVALID_PLAYER_ID;
-    Buffer recvBuffer;
+
+    // Set once the poller reports data or a disconnect, only readable
+    // connections are received from.
+    bool readable = true;
+
+    // Tick of the last full state sent, older resync requests are already
+    // answered by it.
+    uint32_t syncTick = 0;
+
+    // Last tick everything queued for the connection was sent.
+    uint32_t flushedTick = 0;
+
+    // Frames are held back until the backlog is gone, see
+    // NETWORK_BACKLOG_TICKS.
+    bool stalled = false;
+
+    // Set on errors and for clients that fell too far behind, the
+    // connection is dropped with the next update.
+    bool failed = false;
+
+    // Frame events before this offset are part of the last state sent.
+    size_t frameStart = 0;
+
+    RecvBuffer_t recvBuffer;
+
+    // Messages for this connection only, sent in order with the queue.
     Buffer sendBuffer;
+    std::deque<QueuedChunk_t> sendQueue;
+
+    // Bytes of the first queued chunk already sent.
+    size_t sendChunkOffset = 0;
+
+    // Bytes of sendQueue not sent yet.
+    size_t sendQueueBytes = 0;
+
+    // Cleared when the socket did not take everything, set again once the
+    // poller reports it writable.
+    bool writable = true;
+
+    // Ring backend, the connection is only destroyed once the kernel
+    // completed both operations.
+    bool recvQueued = false;
+    bool sendQueued = false;
+
+    // What the queued send is made of, new messages go to sendBuffer and
+    // sendQueue meanwhile.
+    Buffer ringSendBuffer;
+    std::vector<SendChunk> ringSendChunks;
+    size_t ringSendBytes = 0;
+
+    // Network threads, the one servicing the connection and where the
+    // connection is in Network::_connections.
+    uint32_t ioThread = 0;
+    size_t index = 0;
+    ConnectionIO_t io;
+
+    // Handed to the network thread but not sent yet.
+    std::atomic<size_t> ioSendBytes{ 0 };
+
+    // What sendBuffer was handed to the network thread in. One the thread
+    // let go of swaps places with sendBuffer, both keep their storage.
+    std::vector<std::shared_ptr<Buffer>> ioSendBuffers;
 };
 
+class NetworkThread;
+struct NetworkInput_t;
+
 class Network
 {
     NetworkMode _mode = NetworkMode::NONE;
 
+    // Servers receive from all UDP clients on it, a client is connected to
+    // the server with it.
+    std::unique_ptr<IUdpSocket> _udpSocket;
+    std::vector<SocketDatagram_t> _datagrams;
+    std::vector<uint8_t> _datagramData;
+    std::vector<SocketDatagram_t> _sendDatagrams;
+
+    // Serialized unreliable message, see sendUnreliable.
+    Buffer _messageBuffer;
+
 private:     // Server specific data.
     std::unique_ptr<ITcpSocket> _listenSocket;
     std::vector<std::unique_ptr<Connection>> _connections;
 
+    // UDP clients by the address their datagrams come from.
+    std::map<SocketAddress_t, Connection*> _udpConnections;
+
+    // Random key of the cookies sent to UDP clients that connect.
+    uint64_t _cookieKey[2]{};
+
+    // Reports the listen socket with itself and each client socket with
+    // its connection as user data.
+    std::unique_ptr<ISocketPoller> _poller;
+    std::vector<SocketReady_t> _readySockets;
+
+    // Used instead of the poller with NetworkBackend::RING.
+    std::unique_ptr<ISocketRing> _ring;
+    std::vector<SocketCompletion_t> _completions;
+
+    // Disconnected but the ring still has operations on their buffers or
+    // their network thread did not let go of them yet.
+    std::vector<std::unique_ptr<Connection>> _closedConnections;
+
+    // Receive and send for the connections instead of the poller, the
+    // first one also accepts.
+    std::vector<std::unique_ptr<NetworkThread>> _threads;
+    uint32_t _nextThread = 0;
+
+    // Events of the current tick, sent to all clients by sendFrame.
+    Buffer _frameEvents;
+
+    // Client inputs by the tick they are meant for, the lists keep their
+    // storage. Everything up to _inputTick was applied.
+    std::array<std::vector<QueuedInput_t>, NETWORK_INPUT_TICKS> _inputs;
+    uint32_t _inputTick = 0;
+
+    // Scratch list for flushConnection.
+    std::vector<SocketSlice_t> _sendSlices;
+
 private:     // Client specific data.
     std::unique_ptr<ITcpSocket> _clientSocket;
     std::unique_ptr<Connection> _serverConnection;
@@ -45,23 +325,48 @@ private:     // Client specific data.
 
     // Last measured client ping.
     uint32_t _currentPing = 0;
+    double _lastPingTime = 0.0;
+
+    // Events that have to be executed at a specific tick, in the order they
+    // arrived which is ordered by tick. Events for a tick the client already
+    // passed are dropped.
+    RingBuffer<TickEvent_t> _tickEvents{ NETWORK_TICK_EVENTS };
+    RingBuffer<Player> _joinedPlayers{ NETWORK_JOINED_PLAYERS };
+    MessageServerSnakeList _snakeList;
+    MessageServerPlayerList _playerList;
+
+    // Server state hashes by tick, checked once the client reaches the tick.
+    std::array<TickHash_t, NETWORK_STATE_HASH_HISTORY> _stateHashes;
+    bool _desync = false;
 
-    // This is used as a queue where events have to be executed at a 
-    // specific tick. The order of events is same order as packets
-    // arrive which is on TCP always ordered per tick.
-    std::multimap<uint32_t, std::function<void()>> _tickQueue;
+    // Desyncs detected or events dropped since the client started, each one
+    // asked the server for a resync.
+    uint32_t _desyncCount = 0;
 
 public:
     Network();
     ~Network();
 
+    // With network threads all socket work of the sockets backend happens
+    // on them, the game thread only handles whole messages. UDP clients are
+    // taken on the same port as well unless the transport is TCP, only by
+    // the sockets backend without threads.
     void startServer(
-        const std::string& address, uint16_t port = NETWORK_DEFAULT_PORT);
+        const std::string& address, uint16_t port = NETWORK_DEFAULT_PORT,
+        NetworkBackend backend = NetworkBackend::SOCKETS,
+        uint32_t threads = 0,
+        NetworkTransport transport = NetworkTransport::TCP);
     void startClient(
-        const std::string& address, uint16_t port = NETWORK_DEFAULT_PORT);
+        const std::string& address, uint16_t port = NETWORK_DEFAULT_PORT,
+        NetworkTransport transport = NetworkTransport::TCP);
     void update();
     void flush();
 
+    // Sleeps until a client sends something or the timeout in milliseconds
+    // passes, returns right away unless we are the server. Always sleeps
+    // the whole timeout with network threads.
+    void wait(int32_t timeoutMs);
+
     uint32_t getCurrentPing() const
     {
         return _currentPing;
@@ -72,44 +377,142 @@ public:
         return _mode;
     }
 
+    NetworkBackend getBackend() const
+    {
+        return _ring != nullptr ? NetworkBackend::RING
+                                : NetworkBackend::SOCKETS;
+    }
+
     uint32_t getServerTick() const
     {
         return _serverTick;
     }
 
-    // Send message to specified connection.
+    // Compares the client state with the server at the given tick, returns
+    // false on a mismatch. Ticks the server hash is not known for pass.
+    bool checkStateHash(uint32_t tick, uint64_t hash);
+
+    bool isDesynced() const
+    {
+        return _desync;
+    }
+
+    uint32_t getDesyncCount() const
+    {
+        return _desyncCount;
+    }
+
+    // Changes the direction of a snake, the server forwards it to all
+    // clients.
+    void setSnakeDirection(SnakeId snakeId, const Vector2i& newDirection);
+
+    // Sends the events of the tick that just ended as one frame to each
+    // client, called once per tick.
+    void sendFrame();
+
+    // Adds an event to the frame of the current tick, clients apply it at
+    // the same tick. Does nothing unless we are the server.
+    template<typename T> void sendEvent(const T& message)
+    {
+        if (getMode() != NetworkMode::SERVER)
+            return;
+
+        // The event is written in place after a byte for its size, the size
+        // is filled in once known. Only events of 128 bytes or more need a
+        // longer size, their payload is moved for it.
+        Serializer<VarUInt>::serialize(_frameEvents, VarUInt{ T::MESSAGE_ID });
+        const size_t sizeOffset = _frameEvents.room(1);
+        message.serialize(_frameEvents);
+
+        uint8_t size[Serializer<VarUInt>::MAX_BYTES];
+        const size_t sizeLen = Serializer<VarUInt>::encode(
+            static_cast<uint32_t>(_frameEvents.offset() - sizeOffset - 1),
+            size);
+        if (sizeLen > 1)
+        {
+            _frameEvents.seek(sizeOffset + 1);
+            _frameEvents.insert(size + 1, sizeLen - 1);
+            _frameEvents.seek(0, BufferSeek::END);
+        }
+        memcpy(&_frameEvents[sizeOffset], size, sizeLen);
+    }
+
+    template<typename T, typename F>
+    bool dispatchEvent(Buffer& buffer, uint32_t tick, F fn)
+    {
+        T msg;
+        if (!msg.deserialize(buffer))
+            return false;
+        return (this->*fn)(tick, msg);
+    }
+
+    // Appends the header and message to the buffer.
     template<typename T>
-    void sendMessage(const T& message, std::unique_ptr<Connection>& connection)
+    static void writeMessage(const T& message, Buffer& buffer)
     {
-        Buffer messageBuffer;
-        message.serialize(messageBuffer);
+        // The message is written in place, the header is filled in once its
+        // size is known.
+        const size_t headerOffset = buffer.room(sizeof(MessageHeader_t));
+        message.serialize(buffer);
 
         MessageHeader_t header;
         header.signature = NETWORK_MESSAGE_SIGNATURE;
-        header.size = messageBuffer.size();
+        header.size = static_cast<uint32_t>(
+            buffer.offset() - headerOffset - sizeof(header));
         header.msg = static_cast<NetworkMessage>(T::MESSAGE_ID);
 
-        auto& buffer = connection->sendBuffer;
-        header.serialize(buffer);
-        buffer.write(messageBuffer);
+        memcpy(&buffer[headerOffset], &header, sizeof(header));
     }
 
-    // Broadcast a message.
+    // Send message to specified connection.
+    template<typename T>
+    void sendMessage(const T& message, std::unique_ptr<Connection>& connection)
+    {
+        writeMessage(message, connection->sendBuffer);
+    }
+
+    // Over UDP the message only goes with the next packet and is gone if
+    // that is lost, for messages a newer one replaces anyway. Sent like any
+    // other message over TCP.
+    template<typename T>
+    void sendUnreliable(
+        const T& message, std::unique_ptr<Connection>& connection)
+    {
+        if (connection->channel == nullptr)
+        {
+            sendMessage(message, connection);
+            return;
+        }
+
+        _messageBuffer.clear();
+        writeMessage(message, _messageBuffer);
+        connection->channel->writeUnreliable(
+            _messageBuffer.base(), _messageBuffer.size());
+    }
+
+    // Broadcast a message, it is serialized once for all connections.
     template<typename T> void sendMessage(const T& message)
     {
         if (getMode() == NetworkMode::CLIENT)
         {
             sendMessage(message, _serverConnection);
         }
-        else
+        else if (!_connections.empty())
         {
+            auto chunk = std::make_shared<Buffer>();
+            writeMessage(message, *chunk);
+
             for (auto& connection : _connections)
             {
-                sendMessage(message, connection);
+                queueChunk(connection, chunk);
             }
         }
     }
 
+    // Sends the chunk after everything sent to the connection so far.
+    void queueChunk(
+        std::unique_ptr<Connection>& connection, const SendChunk& chunk);
+
     template<typename T, typename F>
     bool dispatchMessage(
         Buffer& buffer, std::unique_ptr<Connection>& connection, F fn)
@@ -129,14 +532,54 @@ public:
 private: // Common
     void updateServer();
     void updateClient();
+    void pollSockets(int32_t timeoutMs);
+    void submitRing(int32_t timeoutMs);
+    void receiveThreads();
+    void processInput(const NetworkInput_t& input, uint8_t* data);
+    void closeFailedConnections();
+    void acceptConnections();
+    void receiveDatagrams();
+    void receiveDatagram(const SocketDatagram_t& datagram, double now);
+
+    // Takes a client whose connect carries a cookie and a hello, answers
+    // any other connect with a challenge.
+    void receiveConnect(const SocketDatagram_t& datagram, double now);
+    uint64_t getCookie(const SocketAddress_t& address, uint64_t period) const;
+    void sendDatagrams();
+    bool watchConnection(std::unique_ptr<Connection>& connection);
+    void releaseConnection(std::unique_ptr<Connection>& connection);
+    void gatherSendSlices(std::unique_ptr<Connection>& connection);
+    void queueSend(std::unique_ptr<Connection>& connection);
+    void queueThreadSend(std::unique_ptr<Connection>& connection);
+    SendChunk takeThreadSendBuffer(std::unique_ptr<Connection>& connection);
+    bool queueReceive(std::unique_ptr<Connection>& connection);
     void flushConnection(std::unique_ptr<Connection>& connection);
+    void flushChannel(std::unique_ptr<Connection>& connection);
     bool processConnection(std::unique_ptr<Connection>& connection);
+    bool processChannel(std::unique_ptr<Connection>& connection);
     bool processPackets(std::unique_ptr<Connection>& connection);
 
+    // Dispatches the complete messages in the data, processed is the size
+    // they took.
+    bool processMessages(
+        std::unique_ptr<Connection>& connection, uint8_t* data, size_t size,
+        size_t& processed);
+
+    const char* getHostName(
+        const std::unique_ptr<Connection>& connection) const;
+    void disconnect(std::unique_ptr<Connection>& connection);
+
+public:
+    static void reserveRecvSpace(RecvBuffer_t& recv);
+
 private: // Server events
     void onClientConnected(std::unique_ptr<Connection>& clientConnection);
     void onClientDisconnected(std::unique_ptr<Connection>& clientConnection);
 
+    // Applies the inputs held back for the ticks up to the current one.
+    void applyInputs();
+    void applyInput(const QueuedInput_t& input);
+
 private: // Server message dispatchers.
     void onClientMessageHello(
         std::unique_ptr<Connection>& clientConnection,
@@ -146,15 +589,48 @@ private: // Server message dispatchers.
         const MessageClientSnakeDirection& msg);
     void onClientMessagePing(
         std::unique_ptr<Connection>& connection, const MessageClientPing& msg);
+    void onClientMessageResync(
+        std::unique_ptr<Connection>& connection,
+        const MessageClientResync& msg);
+
+private: // Server helpers.
+    // Sends players, tiles and snakes of the current tick.
+    void sendState(std::unique_ptr<Connection>& connection);
+
+    // Bytes queued for the connection that did not go out yet.
+    size_t getSendBacklog(const std::unique_ptr<Connection>& connection) const;
+
+    // Holds back frames for clients that fall behind and drops the ones
+    // that do not catch up, returns false if the connection gets no frame
+    // this tick.
+    bool checkBacklog(std::unique_ptr<Connection>& connection);
 
 private: // Client events.
     void onConnected();
     void onDisconnected();
 
+    // Runs the queued events of the current tick.
+    void runTickEvents();
+    void runTickEvent(const TickEvent_t& event);
+
+    // Takes the world back to the start of the tick and simulates again up
+    // to the current tick, now with the events that arrived for it.
+    void rollback(uint32_t tick);
+    void dropTickEvent(const TickEvent_t& event);
+
+    // Queues the event, or drops everything queued and asks for a resync if
+    // there is no room left.
+    void queueTickEvent(const TickEvent_t& event);
+    void queueJoinedPlayer(const Player& player, const TickEvent_t& event);
+    void dropTickEvents(uint32_t tick);
+
+    // Asks the server for its state once until it arrived.
+    void requestResync(uint32_t tick);
+
 private: // Client message dispatchers.
-    void onServerMessageTick(
+    void onServerMessageFrame(
         std::unique_ptr<Connection>& serverConnection,
-        const MessageServerTick& msg);
+        MessageServerFrame& msg);
     void onServerMessagePlayerLocalId(
         std::unique_ptr<Connection>& serverConnection,
         const MessageServerLocalPlayerId& msg);
@@ -164,27 +640,34 @@ private: // Client message dispatchers.
     void onServerMessagePlayerList(
         std::unique_ptr<Connection>& serverConnection,
         const MessageServerPlayerList& msg);
+    void onServerMessageArena(
+        std::unique_ptr<Connection>& serverConnection,
+        const MessageServerArena& msg);
     void onServerMessageState(
         std::unique_ptr<Connection>& serverConnection,
         const MessageServerState& msg);
-    void onServerMessageSnakeDirection(
-        std::unique_ptr<Connection>& serverConnection,
-        const MessageServerSnakeDirection& msg);
-    void onServerMessageRoundRestart(
-        std::unique_ptr<Connection>& serverConnection,
-        const MessageServerRoundRestart& msg);
-    void onServerMessageRoundState(
-        std::unique_ptr<Connection>& serverConnection,
-        const MessageServerRoundState& msg);
-    void onServerMessagePlayerDisconnected(
-        std::unique_ptr<Connection>& serverConnection,
-        const MessageServerPlayerDisconnected& msg);
-    void onServerMessageRoundStart(
-        std::unique_ptr<Connection>& serverConnection,
-        const MessageServerRoundStart& msg);
     void onServerMessagePong(
         std::unique_ptr<Connection>& serverConnection,
         const MessageServerPong& msg);
+    void onServerMessageInputAck(
+        std::unique_ptr<Connection>& serverConnection,
+        const MessageServerInputAck& msg);
+
+private: // Client frame event handlers.
+    // Queue the event for its tick, false if it names a player or snake
+    // out of range of the arena.
+    bool onServerEventPlayerJoined(
+        uint32_t tick, const MessageServerPlayerJoined& msg);
+    bool onServerEventPlayerDisconnected(
+        uint32_t tick, const MessageServerPlayerDisconnected& msg);
+    bool onServerEventSnakeDirection(
+        uint32_t tick, const MessageServerSnakeDirection& msg);
+    bool onServerEventRoundRestart(
+        uint32_t tick, const MessageServerRoundRestart& msg);
+    bool onServerEventRoundState(
+        uint32_t tick, const MessageServerRoundState& msg);
+    bool onServerEventRoundStart(
+        uint32_t tick, const MessageServerRoundStart& msg);
 };
 
 extern Network gNetwork;
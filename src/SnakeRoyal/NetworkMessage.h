@@ -7,6 +7,7 @@
 #include "Players.h"
 #include "Game.h"
 #include "Snake.h"
+#include "Utils.h"
 
 enum NetworkMessage : uint16_t
 {
@@ -15,23 +16,27 @@ enum NetworkMessage : uint16_t
     CLIENT_HELLO,
     CLIENT_SNAKE_DIRECTION,
     CLIENT_PING,
+    CLIENT_RESYNC,
 
     SERVER_PONG,
     SERVER_PLAYER_LIST,
+    SERVER_PLAYER_JOINED,
     SERVER_PLAYER_DISCONNECTED,
     SERVER_LOCAL_PLAYER_ID,
     SERVER_STATE,
-    SERVER_TICK,
+    SERVER_FRAME,
     SERVER_SNAKE_LIST,
     SERVER_SNAKE_DIRECTION,
     SERVER_ROUND_STATE,
     SERVER_ROUND_RESTART,
     SERVER_ROUND_START,
     SERVER_ASSIGN_SNAKE,
+    SERVER_ARENA,
+    SERVER_INPUT_ACK,
 };
 
 static constexpr uint32_t NETWORK_MESSAGE_SIGNATURE = 0xDEADBEEF;
-static constexpr uint32_t NETWORK_VERSION = 1;
+static constexpr uint32_t NETWORK_VERSION = 10;
 
 template<typename T, NetworkMessage MSG = NetworkMessage::BASE>
 struct MessageBasePOD
@@ -60,15 +65,69 @@ struct MessageBaseComplex
         MESSAGE_ID = MSG
     };
 
-    template<typename T>
-    bool serializeField(Buffer& buffer, const T& data) const
+    template<typename F>
+    bool serializeField(Buffer& buffer, const F& data) const
     {
-        return Serializer<T>::serialize(buffer, data);
+        return Serializer<F>::serialize(buffer, data);
     }
 
-    template<typename T> bool deserializeField(Buffer& buffer, T& data)
+    template<typename F> bool deserializeField(Buffer& buffer, F& data)
     {
-        return Serializer<T>::deserialize(buffer, data);
+        return Serializer<F>::deserialize(buffer, data);
+    }
+
+    template<typename F>
+    bool serializeField(BitWriter& writer, const F& data) const
+    {
+        return Serializer<F>::serialize(writer, data);
+    }
+
+    template<typename F> bool deserializeField(BitReader& reader, F& data)
+    {
+        return Serializer<F>::deserialize(reader, data);
+    }
+};
+
+// The snake id is sent plus one so INVALID_SNAKE_ID wraps to 0 and takes a
+// single byte, the name is sent without the unused part of the array.
+template<> struct Serializer<Player>
+{
+    static bool serialize(Buffer& buffer, const Player& data)
+    {
+        const size_t nameLen = strnlen(data.name, sizeof(data.name) - 1);
+
+        Serializer<VarUInt>::serialize(buffer, VarUInt{ data.id });
+        Serializer<VarUInt>::serialize(
+            buffer, VarUInt{ static_cast<SnakeId>(data.snakeId + 1) });
+        buffer.write(data.color);
+        Serializer<VarUInt>::serialize(buffer, VarUInt{ data.pressed });
+        buffer.write(static_cast<uint8_t>(nameLen));
+        buffer.write(data.name, nameLen);
+        return true;
+    }
+    static bool deserialize(Buffer& buffer, Player& data)
+    {
+        VarUInt id;
+        VarUInt snakeId;
+        VarUInt pressed;
+        uint8_t nameLen = 0;
+
+        data = Player{};
+        if (!Serializer<VarUInt>::deserialize(buffer, id)
+            || !Serializer<VarUInt>::deserialize(buffer, snakeId)
+            || buffer.read(data.color) != sizeof(data.color)
+            || !Serializer<VarUInt>::deserialize(buffer, pressed)
+            || buffer.read(nameLen) != sizeof(nameLen))
+            return false;
+
+        if (nameLen >= sizeof(data.name)
+            || buffer.read(data.name, nameLen) != nameLen)
+            return false;
+
+        data.id = static_cast<PlayerId>(id.value);
+        data.snakeId = static_cast<SnakeId>(snakeId.value - 1);
+        data.pressed = pressed.value;
+        return true;
     }
 };
 
@@ -86,18 +145,121 @@ struct MessageClientHello
     char name[128];
 };
 
-struct MessageServerTick
-    : MessageBasePOD<MessageServerTick, NetworkMessage::SERVER_TICK>
+// Sent once per tick to every client, tick is the new server tick. Holds the
+// events of the tick before, each as message id and payload size followed
+// by the payload, and the state hash at the end of it. Clients compare the
+// hash once they reach the same tick.
+struct MessageServerFrame
+    : MessageBaseComplex<MessageServerFrame, NetworkMessage::SERVER_FRAME>
 {
     uint32_t tick;
+    uint64_t stateHash;
+
+    // Received events borrow the receive buffer, sent events are only
+    // referenced.
+    Buffer events;
+    const uint8_t* eventsData = nullptr;
+    size_t eventsSize = 0;
+
+    // Sends the events from offset start on, the buffer must outlive the
+    // serialization.
+    void setEvents(const Buffer& buffer, size_t start)
+    {
+        eventsData = buffer.base() + start;
+        eventsSize = buffer.size() - start;
+    }
+
+    bool serialize(Buffer& buffer) const
+    {
+        serializeField(buffer, VarUInt{ tick });
+        serializeField(buffer, stateHash);
+        serializeField(buffer, VarUInt{ static_cast<uint32_t>(eventsSize) });
+        if (eventsSize > 0)
+            buffer.write(eventsData, eventsSize);
+        return true;
+    }
+
+    bool deserialize(Buffer& buffer)
+    {
+        VarUInt tickValue;
+        if (!deserializeField(buffer, tickValue))
+            return false;
+        tick = tickValue.value;
+
+        if (!deserializeField(buffer, stateHash))
+            return false;
+
+        VarUInt size;
+        if (!deserializeField(buffer, size))
+            return false;
+
+        if (buffer.offset() + size.value > buffer.size())
+            return false;
+
+        events.borrow(buffer.base() + buffer.offset(), size.value);
+        buffer.seek(size.value, BufferSeek::CUR);
+        return true;
+    }
 };
 
-struct MessageServerPlayerList : MessageBasePOD<
+// Only holds the valid players, slots that are not listed are free.
+struct MessageServerPlayerList : MessageBaseComplex<
                                      MessageServerPlayerList,
                                      NetworkMessage::SERVER_PLAYER_LIST>
 {
     uint32_t tick;
-    std::array<Player, MAX_PLAYERS> players;
+    std::vector<Player> players;
+
+    bool serialize(Buffer& buffer) const
+    {
+        serializeField(buffer, VarUInt{ tick });
+        serializeField(
+            buffer, VarUInt{ static_cast<uint32_t>(players.size()) });
+        for (const Player& player : players)
+        {
+            serializeField(buffer, player);
+        }
+        return true;
+    }
+
+    bool deserialize(Buffer& buffer)
+    {
+        VarUInt tickValue;
+        VarUInt playerCount;
+        if (!deserializeField(buffer, tickValue)
+            || !deserializeField(buffer, playerCount))
+            return false;
+
+        if (playerCount.value > INVALID_PLAYER_ID)
+            return false;
+
+        tick = tickValue.value;
+        players.resize(playerCount.value);
+        for (Player& player : players)
+        {
+            if (!deserializeField(buffer, player))
+                return false;
+        }
+        return true;
+    }
+};
+
+// Frame event, the new client gets the player with the rest of the state.
+struct MessageServerPlayerJoined : MessageBaseComplex<
+                                       MessageServerPlayerJoined,
+                                       NetworkMessage::SERVER_PLAYER_JOINED>
+{
+    Player player;
+
+    bool serialize(Buffer& buffer) const
+    {
+        return serializeField(buffer, player);
+    }
+
+    bool deserialize(Buffer& buffer)
+    {
+        return deserializeField(buffer, player);
+    }
 };
 
 struct MessageServerLocalPlayerId : MessageBasePOD<
@@ -107,121 +269,385 @@ struct MessageServerLocalPlayerId : MessageBasePOD<
     PlayerId playerId;
 };
 
+struct MessageServerArena
+    : MessageBasePOD<MessageServerArena, NetworkMessage::SERVER_ARENA>
+{
+    int32_t width;
+    int32_t height;
+    uint32_t maxPlayers;
+};
+
+// Tiles are sent as runs of non empty cells, see TileMap::getRuns. Sent on
+// join and whenever a client asks for a resync.
 struct MessageServerState
-    : MessageBasePOD<MessageServerState, NetworkMessage::SERVER_STATE>
+    : MessageBaseComplex<MessageServerState, NetworkMessage::SERVER_STATE>
 {
     uint32_t tick;
     uint32_t randState;
     RoundData_t roundData;
-    uint32_t timeout;
-    std::array<TileData_t, TILE_MAP_SIZE> tiles;
+    std::vector<uint32_t> tileRuns;
+    std::vector<TileData_t> tiles;
+
+    bool serialize(Buffer& buffer) const
+    {
+        serializeField(buffer, tick);
+        serializeField(buffer, randState);
+        buffer.write(roundData);
+        serializeField(buffer, tileRuns);
+        serializeField(buffer, tiles);
+        return true;
+    }
+
+    bool deserialize(Buffer& buffer)
+    {
+        if (!deserializeField(buffer, tick))
+            return false;
+        if (!deserializeField(buffer, randState))
+            return false;
+        if (buffer.read(roundData) != sizeof(roundData))
+            return false;
+        if (!deserializeField(buffer, tileRuns))
+            return false;
+        return deserializeField(buffer, tiles);
+    }
 };
 
+// Only holds the valid snakes, slots that are not listed are free. Each
+// piece is the step from the piece before in 2 bits, only the head is sent
+// as cell. Snakes that can not be described by steps, which only happens on
+// maps 1 cell wide or high, send every piece as cell instead. Cells are
+// packed for the map size sent along, the receiver checks it matches its
+// arena.
 struct MessageServerSnakeList : MessageBaseComplex<
                                     MessageServerSnakeList,
                                     NetworkMessage::SERVER_SNAKE_LIST>
 {
+    static constexpr uint32_t STATE_BITS = 2;
+    static constexpr uint32_t STEP_BITS = 2;
+
     uint32_t tick;
-    std::array<Snake, MAX_PLAYERS> snakes;
+    int32_t width;
+    int32_t height;
+    std::vector<Snake> snakes;
 
     bool serialize(Buffer& buffer) const
     {
-        serializeField(buffer, tick);
-
-        uint16_t snakeCount = static_cast<uint16_t>(snakes.size());
-        serializeField(buffer, snakeCount);
-        for (uint16_t i = 0; i < snakeCount; i++)
+        BitWriter writer(buffer);
+        serializeField(writer, VarUInt{ tick });
+        serializeField(writer, VarUInt{ static_cast<uint32_t>(width) });
+        serializeField(writer, VarUInt{ static_cast<uint32_t>(height) });
+        serializeField(
+            writer, VarUInt{ static_cast<uint32_t>(snakes.size()) });
+
+        for (const Snake& snake : snakes)
         {
-            const Snake& snake = snakes[i];
-            const SnakeBase& baseData = reinterpret_cast<const SnakeBase&>(
-                snake);
+            const uint32_t pieceCount = static_cast<uint32_t>(
+                snake.pieces.size());
+
+            serializeField(writer, VarUInt{ snake.id });
+            writer.write(static_cast<uint32_t>(snake.state), STATE_BITS);
+            serializeField(writer, PackedDirection{ snake.direction });
+            serializeField(writer, VarUInt{ snake.playerId });
+            serializeField(writer, VarUInt{ pieceCount });
+
+            if (pieceCount == 0)
+                continue;
 
-            buffer.write(baseData);
+            const PackedCell head{ snake.pieces[0], width, height };
+            serializeField(writer, head);
 
-            uint16_t tailCount = static_cast<uint16_t>(snake.pieces.size());
-            serializeField(buffer, tailCount);
+            bool stepped = true;
+            for (uint32_t i = 1; i < pieceCount && stepped; i++)
+            {
+                stepped = getStep(snake.pieces[i - 1], snake.pieces[i]) >= 0;
+            }
+            writer.write(stepped ? 1 : 0, 1);
 
-            for (uint16_t y = 0; y < tailCount; y++)
+            for (uint32_t i = 1; i < pieceCount; i++)
             {
-                buffer.write(snake.pieces[y]);
+                if (stepped)
+                {
+                    const int32_t step = getStep(
+                        snake.pieces[i - 1], snake.pieces[i]);
+                    writer.write(static_cast<uint32_t>(step), STEP_BITS);
+                }
+                else
+                {
+                    serializeField(
+                        writer, PackedCell{ snake.pieces[i], width, height });
+                }
             }
         }
+
+        writer.flush();
         return true;
     }
 
     bool deserialize(Buffer& buffer)
     {
-        buffer.read(tick);
-
-        uint16_t snakeCount = 0;
-        deserializeField(buffer, snakeCount);
-        for (uint16_t i = 0; i < snakeCount; i++)
+        BitReader reader(buffer);
+
+        VarUInt tickValue;
+        VarUInt widthValue;
+        VarUInt heightValue;
+        VarUInt snakeCount;
+        if (!deserializeField(reader, tickValue)
+            || !deserializeField(reader, widthValue)
+            || !deserializeField(reader, heightValue)
+            || !deserializeField(reader, snakeCount))
+            return false;
+
+        if (widthValue.value == 0 || widthValue.value > TILE_MAP_GRID_MAX
+            || heightValue.value == 0 || heightValue.value > TILE_MAP_GRID_MAX)
+            return false;
+
+        if (snakeCount.value > INVALID_SNAKE_ID)
+            return false;
+
+        tick = tickValue.value;
+        width = static_cast<int32_t>(widthValue.value);
+        height = static_cast<int32_t>(heightValue.value);
+
+        const size_t maxPieces = static_cast<size_t>(width) * height;
+        snakes.resize(snakeCount.value);
+        for (Snake& snake : snakes)
         {
-            Snake& snake = snakes[i];
-            SnakeBase& baseData = reinterpret_cast<SnakeBase&>(snake);
-
-            buffer.read(baseData);
-
-            uint16_t tailCount = 0;
-            deserializeField(buffer, tailCount);
-
-            snake.pieces.resize(tailCount);
-            for (uint16_t y = 0; y < tailCount; y++)
+            VarUInt id;
+            uint32_t state = 0;
+            PackedDirection direction;
+            VarUInt playerId;
+            VarUInt pieceCount;
+            if (!deserializeField(reader, id)
+                || !reader.read(state, STATE_BITS)
+                || !deserializeField(reader, direction)
+                || !deserializeField(reader, playerId)
+                || !deserializeField(reader, pieceCount))
+                return false;
+
+            if (pieceCount.value > maxPieces)
+                return false;
+
+            snake.id = static_cast<SnakeId>(id.value);
+            snake.state = static_cast<SnakeState>(state);
+            snake.direction = direction.value;
+            snake.playerId = static_cast<PlayerId>(playerId.value);
+
+            snake.pieces.clear();
+            if (pieceCount.value == 0)
+                continue;
+
+            snake.pieces.reserve(pieceCount.value);
+
+            PackedCell cell{ {}, width, height };
+            uint32_t stepped = 0;
+            if (!deserializeField(reader, cell) || !reader.read(stepped, 1))
+                return false;
+
+            snake.pieces.pushBack(cell.pos);
+            for (uint32_t i = 1; i < pieceCount.value; i++)
             {
-                buffer.read(snake.pieces[y]);
+                if (stepped)
+                {
+                    uint32_t step = 0;
+                    if (!reader.read(step, STEP_BITS))
+                        return false;
+
+                    cell.pos = wrap(
+                        cell.pos + PACKED_DIRECTIONS[step + 1], width, height);
+                }
+                else if (!deserializeField(reader, cell))
+                {
+                    return false;
+                }
+                snake.pieces.pushBack(cell.pos);
             }
         }
         return true;
     }
+
+private:
+    static Vector2i wrap(Vector2i pos, int32_t width, int32_t height)
+    {
+        pos.x = Utils::mod(pos.x, width);
+        pos.y = Utils::mod(pos.y, height);
+        return pos;
+    }
+
+    // Index of the direction that leads from one piece to the next, -1 if
+    // none does.
+    int32_t getStep(const Vector2i& from, const Vector2i& to) const
+    {
+        for (int32_t step = 0; step < 4; step++)
+        {
+            if (wrap(from + PACKED_DIRECTIONS[step + 1], width, height) == to)
+                return step;
+        }
+        return -1;
+    }
 };
 
-struct MessageClientSnakeDirection : MessageBasePOD<
+// Tick is the one the turn is meant for, the server holds it back until
+// then and acknowledges it by sequence with MessageServerInputAck.
+struct MessageClientSnakeDirection : MessageBaseComplex<
                                          MessageClientSnakeDirection,
                                          NetworkMessage::CLIENT_SNAKE_DIRECTION>
 {
+    uint32_t tick;
+    uint32_t sequence;
     Vector2i newDirection;
+
+    bool serialize(Buffer& buffer) const
+    {
+        BitWriter writer(buffer);
+        serializeField(writer, VarUInt{ tick });
+        serializeField(writer, VarUInt{ sequence });
+        serializeField(writer, PackedDirection{ newDirection });
+        writer.flush();
+        return true;
+    }
+
+    bool deserialize(Buffer& buffer)
+    {
+        BitReader reader(buffer);
+
+        VarUInt tickValue;
+        VarUInt sequenceValue;
+        PackedDirection direction;
+        if (!deserializeField(reader, tickValue)
+            || !deserializeField(reader, sequenceValue)
+            || !deserializeField(reader, direction))
+            return false;
+
+        tick = tickValue.value;
+        sequence = sequenceValue.value;
+        newDirection = direction.value;
+        return true;
+    }
 };
 
-struct MessageServerSnakeDirection : MessageBasePOD<
+// Frame event.
+struct MessageServerSnakeDirection : MessageBaseComplex<
                                          MessageServerSnakeDirection,
                                          NetworkMessage::SERVER_SNAKE_DIRECTION>
 {
-    uint32_t tick;
     SnakeId snakeId;
     Vector2i newDirection;
+
+    bool serialize(Buffer& buffer) const
+    {
+        BitWriter writer(buffer);
+        serializeField(writer, VarUInt{ snakeId });
+        serializeField(writer, PackedDirection{ newDirection });
+        writer.flush();
+        return true;
+    }
+
+    bool deserialize(Buffer& buffer)
+    {
+        BitReader reader(buffer);
+
+        VarUInt id;
+        PackedDirection direction;
+        if (!deserializeField(reader, id)
+            || !deserializeField(reader, direction))
+            return false;
+
+        snakeId = static_cast<SnakeId>(id.value);
+        newDirection = direction.value;
+        return true;
+    }
 };
 
-struct MessageServerRoundState : MessageBasePOD<
+// Frame event.
+struct MessageServerRoundState : MessageBaseComplex<
                                      MessageServerRoundState,
                                      NetworkMessage::SERVER_ROUND_STATE>
 {
-    uint32_t tick;
     RoundState state;
     uint32_t delay;
+
+    bool serialize(Buffer& buffer) const
+    {
+        serializeField(buffer, static_cast<uint8_t>(state));
+        serializeField(buffer, VarUInt{ delay });
+        return true;
+    }
+
+    bool deserialize(Buffer& buffer)
+    {
+        uint8_t stateValue = 0;
+        VarUInt delayValue;
+        if (!deserializeField(buffer, stateValue)
+            || !deserializeField(buffer, delayValue))
+            return false;
+
+        state = static_cast<RoundState>(stateValue);
+        delay = delayValue.value;
+        return true;
+    }
 };
 
-struct MessageServerRoundRestart : MessageBasePOD<
+// Frame event.
+struct MessageServerRoundRestart : MessageBaseComplex<
                                        MessageServerRoundRestart,
                                        NetworkMessage::SERVER_ROUND_RESTART>
 {
-    uint32_t tick;
     uint32_t delay;
+
+    bool serialize(Buffer& buffer) const
+    {
+        return serializeField(buffer, VarUInt{ delay });
+    }
+
+    bool deserialize(Buffer& buffer)
+    {
+        VarUInt delayValue;
+        if (!deserializeField(buffer, delayValue))
+            return false;
+
+        delay = delayValue.value;
+        return true;
+    }
 };
 
-struct MessageServerRoundStart : MessageBasePOD<
+// Frame event without payload.
+struct MessageServerRoundStart : MessageBaseComplex<
                                      MessageServerRoundStart,
                                      NetworkMessage::SERVER_ROUND_START>
 {
-    uint32_t tick;
+    bool serialize(Buffer& buffer) const
+    {
+        return true;
+    }
+
+    bool deserialize(Buffer& buffer)
+    {
+        return true;
+    }
 };
 
+// Frame event.
 struct MessageServerPlayerDisconnected
-    : MessageBasePOD<
+    : MessageBaseComplex<
           MessageServerPlayerDisconnected,
           NetworkMessage::SERVER_PLAYER_DISCONNECTED>
 {
-    uint32_t tick;
     PlayerId playerId;
+
+    bool serialize(Buffer& buffer) const
+    {
+        return serializeField(buffer, VarUInt{ playerId });
+    }
+
+    bool deserialize(Buffer& buffer)
+    {
+        VarUInt id;
+        if (!deserializeField(buffer, id))
+            return false;
+
+        playerId = static_cast<PlayerId>(id.value);
+        return true;
+    }
 };
 
 struct MessageClientPing
@@ -230,8 +656,26 @@ struct MessageClientPing
     double timestamp;
 };
 
+// Sent by a client that detected a desync, the server answers with a new
+// MessageServerState.
+struct MessageClientResync
+    : MessageBasePOD<MessageClientResync, NetworkMessage::CLIENT_RESYNC>
+{
+    uint32_t tick;
+};
+
 struct MessageServerPong
     : MessageBasePOD<MessageServerPong, NetworkMessage::SERVER_PONG>
 {
     double timestamp;
+};
+
+// Answers a MessageClientSnakeDirection as it arrives, tick is the one it
+// gets applied at and receivedTick the server tick when it arrived.
+struct MessageServerInputAck
+    : MessageBasePOD<MessageServerInputAck, NetworkMessage::SERVER_INPUT_ACK>
+{
+    uint32_t sequence;
+    uint32_t tick;
+    uint32_t receivedTick;
 };
\ No newline at end of file
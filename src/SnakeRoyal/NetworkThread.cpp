@@ -0,0 +1,376 @@
+#include "NetworkThread.h"
+#include "Logging.h"
+
+#include <algorithm>
+
+NetworkThread::NetworkThread()
+    : _inputs(NETWORK_THREAD_QUEUE)
+    , _freeInputs(NETWORK_THREAD_QUEUE)
+    , _outputs(NETWORK_THREAD_QUEUE)
+    , _freeOutputs(NETWORK_THREAD_QUEUE)
+{
+    _poller = CreateSocketPoller();
+    _input = std::make_unique<NetworkInputBatch_t>();
+    _output = std::make_unique<NetworkOutputBatch_t>();
+}
+
+NetworkThread::~NetworkThread()
+{
+    stop();
+
+    // Accepted connections the simulation never took over.
+    std::unique_ptr<NetworkInputBatch_t> batch = std::move(_input);
+    do
+    {
+        for (const auto& input : batch->inputs)
+        {
+            if (input.type == NetworkInputType::CONNECTED)
+                delete input.connection;
+        }
+    } while (_inputs.tryPop(batch));
+}
+
+void NetworkThread::start(ITcpSocket* listenSocket)
+{
+    _listenSocket = listenSocket;
+    if (_listenSocket != nullptr)
+        _poller->Add(_listenSocket, _listenSocket);
+
+    _quit = false;
+    _thread = std::thread(&NetworkThread::run, this);
+}
+
+void NetworkThread::stop()
+{
+    if (!_thread.joinable())
+        return;
+
+    _quit = true;
+    _poller->Wake();
+    _thread.join();
+}
+
+void NetworkThread::attach(Connection* connection)
+{
+    _output->outputs.push_back(
+        NetworkOutput_t{ NetworkOutputType::ATTACH, connection, {} });
+}
+
+void NetworkThread::send(
+    Connection* connection, const SendChunk& chunk, size_t offset, size_t size)
+{
+    _output->outputs.push_back(NetworkOutput_t{
+        NetworkOutputType::SEND, connection,
+        SendPiece_t{ chunk, offset, size } });
+}
+
+void NetworkThread::close(Connection* connection)
+{
+    _output->outputs.push_back(
+        NetworkOutput_t{ NetworkOutputType::CLOSE, connection, {} });
+}
+
+void NetworkThread::submit()
+{
+    if (_output->outputs.empty() || !_outputs.tryPush(_output))
+        return;
+
+    if (!_freeOutputs.tryPop(_output))
+        _output = std::make_unique<NetworkOutputBatch_t>();
+
+    _poller->Wake();
+}
+
+bool NetworkThread::receive(std::unique_ptr<NetworkInputBatch_t>& batch)
+{
+    return _inputs.tryPop(batch);
+}
+
+void NetworkThread::recycle(std::unique_ptr<NetworkInputBatch_t>& batch)
+{
+    batch->inputs.clear();
+    batch->data.clear();
+    _freeInputs.tryPush(batch);
+}
+
+void NetworkThread::run()
+{
+    std::unique_ptr<NetworkOutputBatch_t> output;
+
+    while (!_quit)
+    {
+        // Input still waiting for room in the queue is retried soon, the
+        // simulation does not wake us once it took something.
+        const int32_t timeoutMs = _input->inputs.empty()
+                                      ? -1
+                                      : NETWORK_THREAD_RETRY_MS;
+
+        _readySockets.clear();
+        _poller->Wait(timeoutMs, _readySockets);
+
+        for (const auto& ready : _readySockets)
+        {
+            if (ready.userData == _listenSocket)
+            {
+                acceptConnections();
+                continue;
+            }
+
+            auto* connection = static_cast<Connection*>(ready.userData);
+            if (ready.readable && !connection->io.readable)
+            {
+                connection->io.readable = true;
+                _readConnections.push_back(connection);
+            }
+
+            if (ready.writable && !connection->io.writable)
+            {
+                connection->io.writable = true;
+                _poller->SetWriteInterest(
+                    connection->sock.get(), connection, false);
+                queueFlush(connection);
+            }
+        }
+
+        while (_outputs.tryPop(output))
+        {
+            processOutput(*output);
+            output->outputs.clear();
+            _freeOutputs.tryPush(output);
+        }
+
+        for (Connection* connection : _readConnections)
+        {
+            receiveConnection(connection);
+        }
+        _readConnections.clear();
+
+        for (Connection* connection : _flushConnections)
+        {
+            connection->io.flushQueued = false;
+            flushConnection(connection);
+        }
+        _flushConnections.clear();
+
+        // Closed connections are only forgotten by the simulation once this
+        // went through, nothing above can still use them by then.
+        if (!_input->inputs.empty() && _inputs.tryPush(_input))
+        {
+            if (!_freeInputs.tryPop(_input))
+                _input = std::make_unique<NetworkInputBatch_t>();
+        }
+    }
+}
+
+void NetworkThread::acceptConnections()
+{
+    while (true)
+    {
+        std::unique_ptr<ITcpSocket> clientSock = _listenSocket->Accept();
+        if (clientSock == nullptr)
+            break;
+
+        auto connection = std::make_unique<Connection>();
+        connection->sock = std::move(clientSock);
+
+        addInput(NetworkInputType::CONNECTED, connection.release());
+    }
+}
+
+void NetworkThread::processOutput(NetworkOutputBatch_t& batch)
+{
+    for (auto& output : batch.outputs)
+    {
+        Connection* connection = output.connection;
+        auto& io = connection->io;
+
+        switch (output.type)
+        {
+            case NetworkOutputType::ATTACH:
+                if (!_poller->Add(connection->sock.get(), connection))
+                {
+                    logPrint(
+                        "Unable to watch client: %s\n",
+                        connection->sock->GetHostName());
+                    io.failed = true;
+                    addInput(NetworkInputType::DISCONNECTED, connection);
+                }
+                io.index = _connections.size();
+                _connections.push_back(connection);
+                break;
+            case NetworkOutputType::SEND:
+                // Nobody is waiting for it anymore.
+                if (io.failed)
+                    break;
+                io.sendPieces.push_back(std::move(output.piece));
+                queueFlush(connection);
+                break;
+            case NetworkOutputType::CLOSE:
+                if (!io.failed)
+                    _poller->Remove(connection->sock.get());
+                io.failed = true;
+
+                _connections[io.index] = _connections.back();
+                _connections[io.index]->io.index = io.index;
+                _connections.pop_back();
+
+                addInput(NetworkInputType::CLOSED, connection);
+                break;
+        }
+    }
+}
+
+void NetworkThread::receiveConnection(Connection* connection)
+{
+    auto& io = connection->io;
+    io.readable = false;
+    if (io.failed)
+        return;
+
+    // Receive straight into the buffer until the socket has nothing left.
+    auto& recv = connection->recvBuffer;
+    bool disconnected = false;
+    while (true)
+    {
+        Network::reserveRecvSpace(recv);
+
+        const size_t space = recv.data.size() - recv.size;
+        size_t received = 0;
+
+        auto readStatus = connection->sock->ReceiveData(
+            recv.data.data() + recv.size, space, &received);
+        if (readStatus == SocketReadStatus::DISCONNECTED)
+        {
+            disconnected = true;
+            break;
+        }
+        if (readStatus != SocketReadStatus::SUCCESS)
+        {
+            break;
+        }
+
+        recv.size += received;
+        if (received < space)
+        {
+            break;
+        }
+    }
+
+    // Only complete messages are handed over, the rest waits for more.
+    size_t end = recv.readPos;
+    while (recv.size - end >= sizeof(MessageHeader_t))
+    {
+        MessageHeader_t header;
+        memcpy(&header, recv.data.data() + end, sizeof(header));
+
+        if (header.signature != NETWORK_MESSAGE_SIGNATURE)
+        {
+            logPrint("Invalid signature!\n");
+            disconnected = true;
+            break;
+        }
+
+        const size_t messageEnd = sizeof(header) + header.size;
+        if (messageEnd > recv.size - end)
+            break;
+
+        end += messageEnd;
+    }
+
+    if (end > recv.readPos)
+    {
+        auto& data = _input->data;
+
+        NetworkInput_t& input = addInput(
+            NetworkInputType::MESSAGES, connection);
+        input.offset = data.size();
+        input.size = end - recv.readPos;
+
+        data.insert(
+            data.end(), recv.data.begin() + recv.readPos,
+            recv.data.begin() + end);
+
+        recv.readPos = end;
+        if (recv.readPos == recv.size)
+        {
+            recv.readPos = 0;
+            recv.size = 0;
+        }
+    }
+
+    if (disconnected)
+        failConnection(connection);
+}
+
+// Sends the pieces in order with as few calls as possible, what the socket
+// does not take waits until the poller says there is room again.
+void NetworkThread::flushConnection(Connection* connection)
+{
+    auto& io = connection->io;
+    auto& pieces = io.sendPieces;
+    if (io.failed || !io.writable || pieces.empty())
+        return;
+
+    if (connection->sock->GetStatus() != SocketStatus::CONNECTED)
+        return;
+
+    _sendSlices.clear();
+    for (const auto& piece : pieces)
+    {
+        _sendSlices.push_back(SocketSlice_t{
+            piece.chunk->base() + piece.offset, piece.size });
+    }
+
+    size_t sent = connection->sock->SendDataVectored(
+        _sendSlices.data(), _sendSlices.size());
+    connection->ioSendBytes -= sent;
+
+    while (sent > 0)
+    {
+        auto& piece = pieces.front();
+
+        const size_t taken = std::min(sent, piece.size);
+        piece.offset += taken;
+        piece.size -= taken;
+        sent -= taken;
+
+        if (piece.size == 0)
+            pieces.pop_front();
+    }
+
+    if (!pieces.empty())
+    {
+        io.writable = false;
+        _poller->SetWriteInterest(connection->sock.get(), connection, true);
+    }
+}
+
+void NetworkThread::queueFlush(Connection* connection)
+{
+    auto& io = connection->io;
+    if (io.flushQueued || !io.writable)
+        return;
+
+    io.flushQueued = true;
+    _flushConnections.push_back(connection);
+}
+
+void NetworkThread::failConnection(Connection* connection)
+{
+    auto& io = connection->io;
+    if (io.failed)
+        return;
+
+    _poller->Remove(connection->sock.get());
+    io.failed = true;
+    io.sendPieces.clear();
+
+    addInput(NetworkInputType::DISCONNECTED, connection);
+}
+
+NetworkInput_t& NetworkThread::addInput(
+    NetworkInputType type, Connection* connection)
+{
+    _input->inputs.push_back(NetworkInput_t{ type, connection, 0, 0 });
+    return _input->inputs.back();
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "Network.h"
+#include "SpscQueue.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+enum class NetworkInputType
+{
+    // Accepted, the connection belongs to the simulation from now on and
+    // is only serviced once it was attached to a thread.
+    CONNECTED,
+    // Complete messages as received, in NetworkInputBatch_t::data.
+    MESSAGES,
+    // The socket closed or failed.
+    DISCONNECTED,
+    // Answers NetworkOutputType::CLOSE, the connection can be destroyed.
+    CLOSED,
+};
+
+struct NetworkInput_t
+{
+    NetworkInputType type;
+    Connection* connection;
+
+    // Messages in NetworkInputBatch_t::data.
+    size_t offset;
+    size_t size;
+};
+
+struct NetworkInputBatch_t
+{
+    std::vector<NetworkInput_t> inputs;
+    std::vector<uint8_t> data;
+};
+
+enum class NetworkOutputType
+{
+    ATTACH,
+    SEND,
+    CLOSE,
+};
+
+struct NetworkOutput_t
+{
+    NetworkOutputType type;
+    Connection* connection;
+
+    // Only for SEND.
+    SendPiece_t piece;
+};
+
+struct NetworkOutputBatch_t
+{
+    std::vector<NetworkOutput_t> outputs;
+};
+
+// Receives, splits into messages and sends for a share of the server
+// connections on its own thread. Both directions are batches passed through
+// lock-free queues, processed batches go back the same way to be reused.
+// Connections are owned by the simulation, a thread forgets one only once
+// it was told to close it.
+class NetworkThread
+{
+    std::thread _thread;
+    std::atomic<bool> _quit{ false };
+
+    std::unique_ptr<ISocketPoller> _poller;
+
+    // Only set on the thread that accepts.
+    ITcpSocket* _listenSocket = nullptr;
+
+    SpscQueue<std::unique_ptr<NetworkInputBatch_t>> _inputs;
+    SpscQueue<std::unique_ptr<NetworkInputBatch_t>> _freeInputs;
+    SpscQueue<std::unique_ptr<NetworkOutputBatch_t>> _outputs;
+    SpscQueue<std::unique_ptr<NetworkOutputBatch_t>> _freeOutputs;
+
+    // Filled by the simulation until submit has room to hand it over.
+    std::unique_ptr<NetworkOutputBatch_t> _output;
+
+private: // Thread specific data.
+    // Filled until the queue has room to hand it over.
+    std::unique_ptr<NetworkInputBatch_t> _input;
+
+    std::vector<Connection*> _connections;
+    std::vector<Connection*> _readConnections;
+    std::vector<Connection*> _flushConnections;
+
+    std::vector<SocketReady_t> _readySockets;
+    std::vector<SocketSlice_t> _sendSlices;
+
+public:
+    NetworkThread();
+    ~NetworkThread();
+
+    // Also accepts from the listen socket unless it is nullptr.
+    void start(ITcpSocket* listenSocket);
+    void stop();
+
+public: // Simulation side.
+    void attach(Connection* connection);
+    void send(
+        Connection* connection, const SendChunk& chunk, size_t offset,
+        size_t size);
+    void close(Connection* connection);
+
+    // Hands over everything since the last submit, if the queue is full it
+    // goes with the next one.
+    void submit();
+
+    // Takes the next input batch, it goes back with recycle.
+    bool receive(std::unique_ptr<NetworkInputBatch_t>& batch);
+    void recycle(std::unique_ptr<NetworkInputBatch_t>& batch);
+
+private: // Thread side.
+    void run();
+    void acceptConnections();
+    void processOutput(NetworkOutputBatch_t& batch);
+    void receiveConnection(Connection* connection);
+    void flushConnection(Connection* connection);
+    void queueFlush(Connection* connection);
+    void failConnection(Connection* connection);
+    NetworkInput_t& addInput(NetworkInputType type, Connection* connection);
+};
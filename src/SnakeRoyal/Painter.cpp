@@ -1,5 +1,6 @@
 #include "Painter.h"
-#include <windows.h>
+
+#ifdef _WIN32
 
 Painter::Painter(HWND hwnd, RECT rect)
     : _hWnd(hwnd)
@@ -176,4 +177,70 @@ void Painter::textRight(
     rc.bottom = y + h;
 
     DrawTextA(_hdcMem, txt.c_str(), -1, &rc, DT_RIGHT | DT_NOPREFIX);
-}
\ No newline at end of file
+}
+
+#else
+
+Painter::Painter(HWND hwnd, RECT rect)
+{
+}
+
+Painter::~Painter()
+{
+}
+
+void Painter::setFont(const char* fontName, int weight)
+{
+}
+
+void Painter::setBgColor(Color color)
+{
+}
+
+void Painter::setColor(Color color)
+{
+}
+
+void Painter::clear(Color color)
+{
+}
+
+void Painter::rect(int32_t x, int32_t y, int32_t w, int32_t h, Color color)
+{
+}
+
+void Painter::filledRect(
+    int32_t x, int32_t y, int32_t w, int32_t h, Color color)
+{
+}
+
+void Painter::filledEllipse(
+    int32_t x, int32_t y, int32_t w, int32_t h, Color color)
+{
+}
+
+void Painter::text(const std::string& txt, int32_t x, int32_t y, Color color)
+{
+}
+
+void Painter::textCentered(
+    const std::string& txt,
+    int32_t x,
+    int32_t y,
+    int32_t w,
+    int32_t h,
+    Color color)
+{
+}
+
+void Painter::textRight(
+    const std::string& txt,
+    int32_t x,
+    int32_t y,
+    int32_t w,
+    int32_t h,
+    Color color)
+{
+}
+
+#endif
\ No newline at end of file
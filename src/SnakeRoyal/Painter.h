@@ -1,12 +1,15 @@
 #pragma once
 
 #include <stdint.h>
-#include <windows.h>
+#include <string>
 
+#include "Platform.h"
 #include "Color.h"
 
+// Without Win32 all drawing is a no-op.
 class Painter
 {
+#ifdef _WIN32
     HWND _hWnd;
     PAINTSTRUCT _ps;
     HDC _hdc;
@@ -19,6 +22,7 @@ class Painter
     Color _brushColor;
     HPEN _pen;
     Color _penColor;
+#endif
 
 public:
     Painter(HWND hWnd, RECT rect);
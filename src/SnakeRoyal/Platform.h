@@ -0,0 +1,61 @@
+#pragma once
+
+// The game itself is Windows only, the simulation and networking also build
+// on other platforms for the dedicated tools. This provides the few Win32
+// types and CRT functions they share with the Windows code.
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+using HWND = void*;
+using HINSTANCE = void*;
+using COLORREF = uint32_t;
+
+struct RECT
+{
+    int32_t left;
+    int32_t top;
+    int32_t right;
+    int32_t bottom;
+};
+
+#define RGB(r, g, b)                                                           \
+    (static_cast<COLORREF>(                                                    \
+        (r) | (static_cast<uint32_t>(g) << 8)                                  \
+        | (static_cast<uint32_t>(b) << 16)))
+
+template<size_t N> inline int strcpy_s(char (&dst)[N], const char* src)
+{
+    snprintf(dst, N, "%s", src);
+    return 0;
+}
+
+template<size_t N> inline int strcat_s(char (&dst)[N], const char* src)
+{
+    const size_t len = strlen(dst);
+    snprintf(dst + len, N - len, "%s", src);
+    return 0;
+}
+
+template<size_t N, typename... Args>
+inline int sprintf_s(char (&dst)[N], const char* fmt, Args... args)
+{
+    return snprintf(dst, N, fmt, args...);
+}
+
+// No keyboard input without a window.
+inline short GetAsyncKeyState(int key)
+{
+    return 0;
+}
+
+inline bool GetClientRect(HWND hWnd, RECT* rect)
+{
+    *rect = RECT{};
+    return false;
+}
+#endif
\ No newline at end of file
@@ -1,12 +1,48 @@
-#include <windows.h>
+#include "Platform.h"
 #include <assert.h>
+#include <algorithm>
 
 #include "Players.h"
 #include "Snakes.h"
 #include "Network.h"
+#include "Prediction.h"
 
 Players gPlayers;
 
+Players::Players()
+{
+    init(MAX_PLAYERS_DEFAULT);
+}
+
+void Players::init(size_t maxPlayers)
+{
+    assert(maxPlayers < INVALID_PLAYER_ID);
+
+    _players.clear();
+    _players.resize(maxPlayers);
+    _localId = INVALID_PLAYER_ID;
+}
+
+void Players::clear()
+{
+    for (auto& player : _players)
+    {
+        player = Player{};
+    }
+}
+
+void Players::copyState(const Players& other)
+{
+    uint32_t pressed = 0;
+    if (_localId < _players.size())
+        pressed = _players[_localId].pressed;
+
+    _players = other._players;
+
+    if (_localId < _players.size())
+        _players[_localId].pressed = pressed;
+}
+
 PlayerId Players::createLocalPlayer(const char* name, SnakeId snakeId)
 {
     PlayerId id = createPlayer(name, snakeId);
@@ -25,7 +61,7 @@ PlayerId Players::createPlayer(const char* name, SnakeId snakeId)
         {
             player.id = id;
             player.snakeId = snakeId;
-            player.color = COLOR_PLAYER_PALETTE[id];
+            player.color = getPlayerColor(id);
             strcpy_s(player.name, name);
 
             res = id;
@@ -122,6 +158,11 @@ void Players::update()
     }
 
     Vector2i curDirection = gSnakes.getDirection(player.snakeId);
+    if (gNetwork.getMode() == NetworkMode::CLIENT)
+    {
+        // Turns still on their way count, they are not sent again.
+        curDirection = gPrediction.getLocalDirection(curDirection);
+    }
     Vector2i newDirection = curDirection;
 
     if (curDirection == DIR_UP || curDirection == DIR_DOWN)
@@ -154,14 +195,18 @@ void Players::update()
     {
         if (gNetwork.getMode() == NetworkMode::CLIENT)
         {
+            gPrediction.setLocalDirection(newDirection);
+
             MessageClientSnakeDirection msgSnakeDir;
+            msgSnakeDir.tick = gPrediction.getInputTick();
+            msgSnakeDir.sequence = gPrediction.getInputSequence();
             msgSnakeDir.newDirection = newDirection;
 
             gNetwork.sendMessage(msgSnakeDir);
         }
         else
         {
-            gSnakes.setDirection(player.snakeId, newDirection);
+            gNetwork.setSnakeDirection(player.snakeId, newDirection);
         }
     }
 }
@@ -198,6 +243,9 @@ void Players::draw(Painter& painter) const
         if (player.id == INVALID_PLAYER_ID)
             break;
 
+        if (offsetY + 20 > PLAYER_LIST_Y + PLAYER_LIST_H)
+            break;
+
         painter.filledRect(
             PLAYER_LIST_X + 10, offsetY, TILE_SIZE_W, TILE_SIZE_H,
             player.color);
@@ -224,12 +272,18 @@ void Players::draw(Painter& painter) const
 
 bool Players::isValidPlayer(PlayerId playerId) const
 {
-    if (playerId >= MAX_PLAYERS || _players[playerId].id == INVALID_PLAYER_ID)
+    if (playerId >= _players.size()
+        || _players[playerId].id == INVALID_PLAYER_ID)
         return false;
 
     return true;
 }
 
+PlayerId Players::getLocalPlayerId() const
+{
+    return _localId;
+}
+
 const Player& Players::getLocalPlayer() const
 {
     assert(_localId != INVALID_PLAYER_ID);
@@ -241,7 +295,7 @@ const Player& Players::getPlayer(PlayerId playerId) const
     return _players[playerId];
 }
 
-const size_t Players::count() const
+size_t Players::count() const
 {
     size_t res = 0;
     for (auto& player : _players)
@@ -251,3 +305,8 @@ const size_t Players::count() const
     }
     return res;
 }
+
+size_t Players::capacity() const
+{
+    return _players.size();
+}
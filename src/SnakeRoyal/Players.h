@@ -9,15 +9,29 @@ class Painter;
 
 class Players
 {
-    std::array<Player, MAX_PLAYERS> _players;
+    std::vector<Player> _players;
     PlayerId _localId = INVALID_PLAYER_ID;
 
 public:
+    Players();
+
+    // Resizes the player slots, all players are removed.
+    void init(size_t maxPlayers);
+
+    // Removes all players but keeps the local player id.
+    void clear();
+
+    // Takes over the players of another instance. The local player id and
+    // the buttons the local player holds are input, not simulation state,
+    // and stay as they are.
+    void copyState(const Players& other);
+
     PlayerId createLocalPlayer(const char* name, SnakeId snakeId);
     PlayerId createPlayer(const char* name, SnakeId snakeId);
     bool removePlayer(PlayerId playerId);
     void setPlayerById(PlayerId playerId, const Player& data);
     void setLocalPlayerId(PlayerId playerId);
+    PlayerId getLocalPlayerId() const;
     void setSnake(PlayerId playerId, SnakeId snakeId);
     uint32_t getScore(PlayerId playerId) const;
     Color getColor(PlayerId playerId) const;
@@ -29,7 +43,8 @@ public:
     const Player& getLocalPlayer() const;
     const Player& getPlayer(PlayerId playerId) const;
 
-    const size_t count() const;
+    size_t count() const;
+    size_t capacity() const;
 };
 
 extern Players gPlayers;
\ No newline at end of file
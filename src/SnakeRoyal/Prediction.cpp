@@ -0,0 +1,147 @@
+#include "Prediction.h"
+#include "Network.h"
+
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+
+Prediction gPrediction;
+
+void Prediction::setLocalDirection(const Vector2i& direction)
+{
+    _pending = true;
+    _direction = direction;
+    _requestTick = gGame.getTick() + getTicksAhead();
+    _applyTick = _requestTick;
+    _inputCount++;
+}
+
+void Prediction::onInputAck(
+    uint32_t sequence, uint32_t tick, uint32_t receivedTick)
+{
+    // Only the last turn sent is still of interest.
+    if (sequence != _inputCount)
+        return;
+
+    if (_pending)
+        _applyTick = tick;
+
+    const int32_t late = static_cast<int32_t>(receivedTick - _requestTick);
+    if (late > 0)
+    {
+        _inputLead = std::min<uint32_t>(
+            _inputLead + late, PREDICTION_MAX_TICKS);
+    }
+    else if (late < -2 && _inputLead > 0)
+    {
+        _inputLead--;
+    }
+}
+
+Vector2i Prediction::getLocalDirection(const Vector2i& confirmed) const
+{
+    return _pending ? _direction : confirmed;
+}
+
+bool Prediction::begin()
+{
+    assert(!_swapped);
+
+    if (gNetwork.getMode() != NetworkMode::CLIENT
+        || gGame.getRoundState() != RoundState::RUNNING)
+        return false;
+
+    updatePending();
+
+    const uint32_t ticks = getTicksAhead();
+    const uint64_t hash = gGame.getStateHash();
+    if (!_built || _builtTick != gGame.getTick() || _builtHash != hash
+        || _builtInputs != _inputCount || _builtTicks != ticks)
+    {
+        build(ticks);
+
+        _built = true;
+        _builtTick = gGame.getTick();
+        _builtHash = hash;
+        _builtInputs = _inputCount;
+        _builtTicks = ticks;
+    }
+
+    swapWorld(_predicted);
+    _swapped = true;
+    return true;
+}
+
+void Prediction::end()
+{
+    assert(_swapped);
+
+    swapWorld(_predicted);
+    _swapped = false;
+}
+
+void Prediction::reset()
+{
+    _pending = false;
+    _built = false;
+    _inputLead = 0;
+}
+
+// About the round trip, a turn sent now arrives at the server before it
+// got that many ticks further.
+uint32_t Prediction::getTicksAhead() const
+{
+    const double ticks = ceil(
+        gNetwork.getCurrentPing() / (GAME_TICK_RATE * 1000.0));
+    return std::clamp<uint32_t>(
+        static_cast<uint32_t>(ticks) + _inputLead, 1, PREDICTION_MAX_TICKS);
+}
+
+void Prediction::updatePending()
+{
+    if (!_pending)
+        return;
+
+    const PlayerId localId = gPlayers.getLocalPlayerId();
+    if (!gPlayers.isValidPlayer(localId))
+    {
+        _pending = false;
+        return;
+    }
+
+    // The server turned the snake, or never will.
+    const SnakeId snakeId = gPlayers.getPlayer(localId).snakeId;
+    if (snakeId == INVALID_SNAKE_ID
+        || gSnakes.getDirection(snakeId) == _direction
+        || gGame.getTick() > _applyTick + PREDICTION_MAX_TICKS)
+    {
+        _pending = false;
+    }
+}
+
+void Prediction::build(uint32_t ticks)
+{
+    saveWorld(_confirmed);
+
+    const PlayerId localId = gPlayers.getLocalPlayerId();
+    for (uint32_t i = 0; i < ticks; i++)
+    {
+        if (gGame.getRoundState() != RoundState::RUNNING)
+            break;
+
+        // Late turns are applied to the first tick that is still predicted.
+        if (_pending && gGame.getTick() >= _applyTick)
+        {
+            const SnakeId snakeId = gPlayers.getPlayer(localId).snakeId;
+            if (snakeId != INVALID_SNAKE_ID)
+                gSnakes.setDirection(snakeId, _direction);
+        }
+
+        gSnakes.update();
+        gGame.setTick(gGame.getTick() + 1);
+    }
+
+    // The simulated world goes aside and the untouched copy comes back.
+    swapWorld(_predicted);
+    swapWorld(_confirmed);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Snapshot.h"
+#include "Vector2.h"
+
+// Ticks past its own tick a client stamps its turns for at most, which is
+// the round trip plus the input lead grown by late turns. The drawn world is
+// predicted as far.
+static constexpr uint32_t PREDICTION_MAX_TICKS = 10;
+
+// Lets clients see their own turns right away. The world the client
+// simulates stays untouched, for drawing a copy of it is run ahead by the
+// round trip time with the local turn applied at the tick the server is
+// expected to apply it. The copy is built again from the simulated world
+// whenever that changes, so mistakes never stick.
+class Prediction
+{
+    // Turn of the local snake the confirmed world does not have yet, sent
+    // for _requestTick and applied by the server at _applyTick.
+    bool _pending = false;
+    Vector2i _direction{};
+    uint32_t _requestTick = 0;
+    uint32_t _applyTick = 0;
+    uint32_t _inputCount = 0;
+
+    // Ticks added to the round trip for turns that arrived too late.
+    uint32_t _inputLead = 0;
+
+    WorldSnapshot_t _predicted;
+    WorldSnapshot_t _confirmed;
+    bool _swapped = false;
+
+    // What the predicted world was built from.
+    bool _built = false;
+    uint32_t _builtTick = 0;
+    uint64_t _builtHash = 0;
+    uint32_t _builtInputs = 0;
+    uint32_t _builtTicks = 0;
+
+public:
+    // Called when the local snake turns, the turn is sent for the tick and
+    // with the sequence returned by the getters below.
+    void setLocalDirection(const Vector2i& direction);
+
+    uint32_t getInputTick() const
+    {
+        return _requestTick;
+    }
+
+    uint32_t getInputSequence() const
+    {
+        return _inputCount;
+    }
+
+    // The server tells at which tick it applies a turn, turns that arrived
+    // late make the next ones go out further ahead.
+    void onInputAck(uint32_t sequence, uint32_t tick, uint32_t receivedTick);
+
+    // The pending turn if there is one, otherwise the confirmed direction.
+    Vector2i getLocalDirection(const Vector2i& confirmed) const;
+
+    // Puts the predicted world in place of the confirmed one until end is
+    // called, returns false if there is nothing to predict.
+    bool begin();
+    void end();
+
+    void reset();
+
+private:
+    uint32_t getTicksAhead() const;
+    void updatePending();
+    void build(uint32_t ticks);
+};
+
+extern Prediction gPrediction;
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <vector>
+
+// Queue for a single thread on a power of two array, the slots of popped
+// items are reused. The capacity is fixed, nothing is taken once it is
+// full.
+template<typename T> class RingBuffer
+{
+    std::vector<T> _items;
+    size_t _mask = 0;
+    size_t _head = 0;
+    size_t _tail = 0;
+
+public:
+    // The capacity is rounded up to a power of two.
+    explicit RingBuffer(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+        {
+            size *= 2;
+        }
+        _items.resize(size);
+        _mask = size - 1;
+    }
+
+    bool empty() const
+    {
+        return _head == _tail;
+    }
+
+    size_t size() const
+    {
+        return _tail - _head;
+    }
+
+    size_t capacity() const
+    {
+        return _items.size();
+    }
+
+    T& front()
+    {
+        assert(!empty());
+        return _items[_head & _mask];
+    }
+
+    // False if the queue is full, the item is not queued then.
+    bool push(const T& item)
+    {
+        if (size() == _items.size())
+            return false;
+
+        _items[_tail & _mask] = item;
+        _tail++;
+        return true;
+    }
+
+    void pop()
+    {
+        assert(!empty());
+        _head++;
+    }
+
+    void clear()
+    {
+        _head = 0;
+        _tail = 0;
+    }
+};
@@ -1,12 +1,100 @@
 #pragma once
 
 #include "Buffer.h"
+#include "Vector2.h"
 
 #include <array>
+#include <iterator>
 #include <vector>
 
 template<typename T> struct Serializer;
 
+// Writes values of up to 32 bits, least significant bit first. Full bytes go
+// to the buffer as they fill up, flush writes the last partial byte.
+class BitWriter
+{
+    Buffer& _buffer;
+    uint64_t _bits = 0;
+    uint32_t _count = 0;
+
+public:
+    explicit BitWriter(Buffer& buffer)
+        : _buffer(buffer)
+    {
+    }
+
+    void write(uint32_t value, uint32_t numBits)
+    {
+        assert(numBits <= 32);
+
+        const uint64_t mask = (1ull << numBits) - 1;
+        _bits |= (value & mask) << _count;
+        _count += numBits;
+
+        while (_count >= 8)
+        {
+            _buffer.write(static_cast<uint8_t>(_bits));
+            _bits >>= 8;
+            _count -= 8;
+        }
+    }
+
+    void flush()
+    {
+        if (_count > 0)
+        {
+            _buffer.write(static_cast<uint8_t>(_bits));
+            _bits = 0;
+            _count = 0;
+        }
+    }
+};
+
+// Reads what BitWriter wrote, the padding of the last byte is dropped with
+// the reader.
+class BitReader
+{
+    Buffer& _buffer;
+    uint64_t _bits = 0;
+    uint32_t _count = 0;
+
+public:
+    explicit BitReader(Buffer& buffer)
+        : _buffer(buffer)
+    {
+    }
+
+    bool read(uint32_t& value, uint32_t numBits)
+    {
+        assert(numBits <= 32);
+
+        while (_count < numBits)
+        {
+            uint8_t byte = 0;
+            if (_buffer.read(byte) != sizeof(byte))
+                return false;
+
+            _bits |= static_cast<uint64_t>(byte) << _count;
+            _count += 8;
+        }
+
+        const uint64_t mask = (1ull << numBits) - 1;
+        value = static_cast<uint32_t>(_bits & mask);
+        _bits >>= numBits;
+        _count -= numBits;
+        return true;
+    }
+};
+
+// Number of bits needed for values up to and including maxValue.
+inline uint32_t bitsFor(uint32_t maxValue)
+{
+    uint32_t bits = 0;
+    while (bits < 32 && (maxValue >> bits) != 0)
+        bits++;
+    return bits;
+}
+
 template<typename T> struct SerializerInteger
 {
     static bool serialize(Buffer& buffer, const T& data)
@@ -35,6 +123,159 @@ template<> struct Serializer<uint64_t> : SerializerInteger<uint64_t>
 {
 };
 
+// Unsigned integer sent as LEB128, 7 bits per byte with the high bit set on
+// all bytes but the last. Values below 128 take a single byte.
+struct VarUInt
+{
+    uint32_t value = 0;
+};
+
+template<> struct Serializer<VarUInt>
+{
+    // Longest encoding of a 32 bit value.
+    static constexpr size_t MAX_BYTES = 5;
+
+    // Encodes the value into bytes, returns how many it took.
+    static size_t encode(uint32_t value, uint8_t (&bytes)[MAX_BYTES])
+    {
+        size_t len = 0;
+        while (value >= 0x80)
+        {
+            bytes[len++] = static_cast<uint8_t>(value | 0x80);
+            value >>= 7;
+        }
+        bytes[len++] = static_cast<uint8_t>(value);
+        return len;
+    }
+
+    static bool serialize(Buffer& buffer, const VarUInt& data)
+    {
+        uint8_t bytes[MAX_BYTES];
+        const size_t len = encode(data.value, bytes);
+        return buffer.write(bytes, len) == len;
+    }
+    static bool deserialize(Buffer& buffer, VarUInt& data)
+    {
+        data.value = 0;
+        for (uint32_t shift = 0; shift < 35; shift += 7)
+        {
+            uint8_t byte = 0;
+            if (buffer.read(byte) != sizeof(byte))
+                return false;
+
+            data.value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    // Same groups of 7 bits in a bit stream.
+    static bool serialize(BitWriter& writer, const VarUInt& data)
+    {
+        uint32_t value = data.value;
+        while (value >= 0x80)
+        {
+            writer.write((value & 0x7F) | 0x80, 8);
+            value >>= 7;
+        }
+        writer.write(value, 8);
+        return true;
+    }
+    static bool deserialize(BitReader& reader, VarUInt& data)
+    {
+        data.value = 0;
+        for (uint32_t shift = 0; shift < 35; shift += 7)
+        {
+            uint32_t byte = 0;
+            if (!reader.read(byte, 8))
+                return false;
+
+            data.value |= (byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+};
+
+// Snake direction quantized to 3 bits, anything but the four directions and
+// DIR_NONE can not be sent.
+struct PackedDirection
+{
+    Vector2i value = DIR_NONE;
+};
+
+static constexpr Vector2i PACKED_DIRECTIONS[] = {
+    DIR_NONE, DIR_UP, DIR_RIGHT, DIR_DOWN, DIR_LEFT,
+};
+
+template<> struct Serializer<PackedDirection>
+{
+    static constexpr uint32_t BITS = 3;
+
+    static bool serialize(BitWriter& writer, const PackedDirection& data)
+    {
+        for (uint32_t i = 0; i < std::size(PACKED_DIRECTIONS); i++)
+        {
+            if (PACKED_DIRECTIONS[i] == data.value)
+            {
+                writer.write(i, BITS);
+                return true;
+            }
+        }
+        return false;
+    }
+    static bool deserialize(BitReader& reader, PackedDirection& data)
+    {
+        uint32_t index = 0;
+        if (!reader.read(index, BITS))
+            return false;
+        if (index >= std::size(PACKED_DIRECTIONS))
+            return false;
+
+        data.value = PACKED_DIRECTIONS[index];
+        return true;
+    }
+};
+
+// Map cell, each axis takes as many bits as the map size needs. The size
+// has to be set before reading.
+struct PackedCell
+{
+    Vector2i pos{};
+    int32_t width = 0;
+    int32_t height = 0;
+};
+
+template<> struct Serializer<PackedCell>
+{
+    static bool serialize(BitWriter& writer, const PackedCell& data)
+    {
+        const uint32_t x = static_cast<uint32_t>(data.pos.x);
+        const uint32_t y = static_cast<uint32_t>(data.pos.y);
+        writer.write(x, bitsFor(data.width - 1));
+        writer.write(y, bitsFor(data.height - 1));
+        return true;
+    }
+    static bool deserialize(BitReader& reader, PackedCell& data)
+    {
+        uint32_t x = 0;
+        uint32_t y = 0;
+        if (!reader.read(x, bitsFor(data.width - 1))
+            || !reader.read(y, bitsFor(data.height - 1)))
+            return false;
+
+        if (x >= static_cast<uint32_t>(data.width)
+            || y >= static_cast<uint32_t>(data.height))
+            return false;
+
+        data.pos.x = static_cast<int32_t>(x);
+        data.pos.y = static_cast<int32_t>(y);
+        return true;
+    }
+};
+
 template<typename T> struct Serializer<std::vector<T>>
 {
     static bool serialize(Buffer& buffer, const std::vector<T>& data)
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Types.h"
+#include "SnakeBody.h"
 
 enum class SnakeState : uint8_t
 {
@@ -19,5 +20,5 @@ struct SnakeBase
 
 struct Snake : SnakeBase
 {
-    std::vector<Vector2i> pieces;
+    SnakeBody pieces;
 };
\ No newline at end of file
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <iterator>
+
+#include "Vector2.h"
+
+// Circular storage for the pieces of a snake, index 0 is always the head.
+// Moving, growing and shrinking only touch the two ends so they are O(1)
+// no matter how long the snake is. The capacity is kept at a power of two so
+// wrapping is a mask, it only grows when the snake outgrows it.
+class SnakeBody
+{
+    static constexpr size_t INITIAL_CAPACITY = 16;
+
+    std::vector<Vector2i> _pieces;
+    size_t _head = 0;
+    size_t _size = 0;
+
+public:
+    template<typename T, typename Body> class IteratorBase
+    {
+        Body* _body;
+        size_t _index;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Vector2i;
+        using difference_type = ptrdiff_t;
+        using pointer = T*;
+        using reference = T&;
+
+        IteratorBase(Body* body, size_t index)
+            : _body(body)
+            , _index(index)
+        {
+        }
+
+        T& operator*() const
+        {
+            return (*_body)[_index];
+        }
+
+        T* operator->() const
+        {
+            return &(*_body)[_index];
+        }
+
+        IteratorBase& operator++()
+        {
+            _index++;
+            return *this;
+        }
+
+        bool operator==(const IteratorBase& other) const
+        {
+            return _index == other._index;
+        }
+
+        bool operator!=(const IteratorBase& other) const
+        {
+            return _index != other._index;
+        }
+    };
+
+    using iterator = IteratorBase<Vector2i, SnakeBody>;
+    using const_iterator = IteratorBase<const Vector2i, const SnakeBody>;
+
+public:
+    Vector2i& operator[](size_t index)
+    {
+        return _pieces[(_head + index) & (_pieces.size() - 1)];
+    }
+
+    const Vector2i& operator[](size_t index) const
+    {
+        return _pieces[(_head + index) & (_pieces.size() - 1)];
+    }
+
+    Vector2i& front()
+    {
+        return (*this)[0];
+    }
+
+    const Vector2i& front() const
+    {
+        return (*this)[0];
+    }
+
+    Vector2i& back()
+    {
+        return (*this)[_size - 1];
+    }
+
+    const Vector2i& back() const
+    {
+        return (*this)[_size - 1];
+    }
+
+    // Adds a new head, the previous head becomes index 1.
+    void pushFront(const Vector2i& pos)
+    {
+        if (_size == _pieces.size())
+            grow();
+
+        _head = (_head - 1) & (_pieces.size() - 1);
+        _pieces[_head] = pos;
+        _size++;
+    }
+
+    // Adds a new tail piece.
+    void pushBack(const Vector2i& pos)
+    {
+        if (_size == _pieces.size())
+            grow();
+
+        _size++;
+        back() = pos;
+    }
+
+    void popBack()
+    {
+        if (_size > 0)
+            _size--;
+    }
+
+    void clear()
+    {
+        _head = 0;
+        _size = 0;
+    }
+
+    size_t size() const
+    {
+        return _size;
+    }
+
+    bool empty() const
+    {
+        return _size == 0;
+    }
+
+    size_t capacity() const
+    {
+        return _pieces.size();
+    }
+
+    void reserve(size_t capacity)
+    {
+        while (_pieces.size() < capacity)
+            grow();
+    }
+
+    iterator begin()
+    {
+        return iterator(this, 0);
+    }
+
+    iterator end()
+    {
+        return iterator(this, _size);
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(this, _size);
+    }
+
+private:
+    void grow()
+    {
+        size_t newCapacity = _pieces.empty() ? INITIAL_CAPACITY
+                                             : _pieces.size() * 2;
+
+        // Unwrap the ring so the head starts at 0 again.
+        std::vector<Vector2i> pieces(newCapacity);
+        for (size_t i = 0; i < _size; i++)
+        {
+            pieces[i] = (*this)[i];
+        }
+
+        _pieces.swap(pieces);
+        _head = 0;
+    }
+};
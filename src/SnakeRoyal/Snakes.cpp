@@ -1,99 +1,189 @@
-#include <array>
 #include "Snakes.h"
 #include "TileMap.h"
 #include "Utils.h"
 #include "Network.h"
 #include "Players.h"
+#include "ThreadPool.h"
+#include <assert.h>
+#include <algorithm>
 
 Snakes gSnakes;
 
-static constexpr Color COLOR_DEAD = COLOR_GREY;
-
-static void moveSnakePiece(
-    Snake& snake, size_t i, Vector2i newPos, TileType type, Color color)
+// Covers everything the simulation reads from a snake, the piece positions
+// besides the head are covered by the tile map hash.
+static uint64_t getSnakeKey(SnakeId slot, const Snake& snake)
 {
-    const Vector2i& oldPos = snake.pieces[i];
-    gTileMap.setData(oldPos.x, oldPos.y, TileType::NONE, COLOR_BG);
-    snake.pieces[i] = newPos;
-    gTileMap.setData(newPos.x, newPos.y, type, color);
+    if (snake.id == INVALID_SNAKE_ID)
+        return 0;
+
+    uint64_t key = Utils::hash64(
+        (static_cast<uint64_t>(slot) << 32)
+        | (static_cast<uint64_t>(snake.playerId) << 8)
+        | static_cast<uint8_t>(snake.state));
+    key = Utils::hash64(
+        key
+        ^ ((static_cast<uint64_t>(static_cast<uint32_t>(snake.direction.x))
+            << 32)
+           | static_cast<uint32_t>(snake.direction.y)));
+    key = Utils::hash64(key ^ snake.pieces.size());
+
+    if (!snake.pieces.empty())
+    {
+        const Vector2i& head = snake.pieces.front();
+        key = Utils::hash64(
+            key
+            ^ ((static_cast<uint64_t>(static_cast<uint32_t>(head.x)) << 32)
+               | static_cast<uint32_t>(head.y)));
+    }
+
+    return key;
 }
 
-static void snakeDeath(Snake& snake)
+static void snakeDeath(Snake& snake, size_t chunk)
 {
     snake.state = SnakeState::DEAD;
     for (auto& pieces : snake.pieces)
     {
-        gTileMap.setData(pieces.x, pieces.y, TileType::SNAKE_DEAD, COLOR_DEAD);
+        gTileMap.setChunkData(
+            chunk, pieces.x, pieces.y, TileType::SNAKE_DEAD, TILE_COLOR_DEAD);
+    }
+}
+
+// Advances the head to newPos, only the cells that change are written: the
+// vacated tail, the old head which becomes tail and the new head.
+static void moveSnake(
+    Snake& snake, const Vector2i& newPos, uint8_t color, bool grow,
+    size_t chunk)
+{
+    const Vector2i oldHead = snake.pieces.front();
+
+    if (!grow)
+    {
+        // With a single piece the tail is also the old head.
+        const Vector2i tailPos = snake.pieces.back();
+        snake.pieces.popBack();
+        gTileMap.setChunkData(
+            chunk, tailPos.x, tailPos.y, TileType::NONE, TILE_COLOR_BG);
     }
+
+    if (!snake.pieces.empty())
+    {
+        gTileMap.setChunkData(
+            chunk, oldHead.x, oldHead.y, TileType::SNAKE_TAIL, color);
+    }
+
+    snake.pieces.pushFront(newPos);
+    gTileMap.setChunkData(
+        chunk, newPos.x, newPos.y, TileType::SNAKE_HEAD, color);
 }
 
-static void updateSnake(Snake& snake)
+// Number of snakes planned per thread pool job.
+static constexpr size_t SNAKES_PER_JOB = 256;
+
+// Decides what the snake does this tick based on the tile map as it was at
+// the start of the tick, nothing is written here.
+static void planMove(const Snake& snake, SnakeMove& move)
 {
+    move.result = SnakeMoveResult::NONE;
+
+    if (snake.id == INVALID_SNAKE_ID || snake.state != SnakeState::ALIVE)
+        return;
+
     if (snake.direction == DIR_NONE)
         return;
 
     const Vector2i head = snake.pieces[0];
 
     Vector2i newPos = head + snake.direction;
-    newPos.x = Utils::mod(newPos.x, TILE_MAP_GRID_W);
-    newPos.y = Utils::mod(newPos.y, TILE_MAP_GRID_H);
-
-    Color color = gPlayers.getColor(snake.playerId);
+    newPos.x = Utils::mod(newPos.x, gTileMap.getWidth());
+    newPos.y = Utils::mod(newPos.y, gTileMap.getHeight());
 
-    bool replaceFood = false;
+    move.pos = newPos;
+    move.cell = static_cast<uint32_t>(
+        newPos.x + (static_cast<size_t>(gTileMap.getWidth()) * newPos.y));
 
-    TileData_t& tileData = gTileMap.getTileData(newPos.x, newPos.y);
-    if (tileData.type == TileType::FOOD)
+    const TileData_t& tileData = gTileMap.getTileData(newPos.x, newPos.y);
+    switch (tileData.type)
     {
-        // Collision with food, grow one tail.
-        snake.pieces.insert(snake.pieces.begin(), newPos);
-        replaceFood = true;
-    }
-    else if (
-        tileData.type == TileType::SNAKE_TAIL
-        || tileData.type == TileType::SNAKE_HEAD)
-    {
-        // Snake collision.
-        snakeDeath(snake);
-        return;
+        case TileType::NONE:
+            move.result = SnakeMoveResult::MOVE;
+            break;
+        case TileType::FOOD:
+            move.result = SnakeMoveResult::GROW;
+            break;
+        case TileType::SNAKE_DEAD:
+            move.result = SnakeMoveResult::SHRINK;
+            break;
+        case TileType::SNAKE_HEAD:
+        case TileType::SNAKE_TAIL:
+            move.result = SnakeMoveResult::DIE;
+            break;
     }
-    else if (tileData.type == TileType::SNAKE_DEAD)
-    {
-        // Remove our tail.
-        auto& tailPos = snake.pieces.back();
-        gTileMap.setData(tailPos.x, tailPos.y, TileType::SNAKE_DEAD, color);
+}
 
-        snake.pieces.pop_back();
-        if (snake.pieces.empty())
-        {
-            snakeDeath(snake);
-            return;
-        }
+static void applyMove(Snake& snake, const SnakeMove& move, size_t chunk)
+{
+    const uint8_t color = getPlayerTileColor(snake.playerId);
 
-        moveSnakePiece(snake, 0, newPos, TileType::SNAKE_HEAD, color);
-    }
-    else
+    switch (move.result)
     {
-        if (snake.pieces.size() > 1)
+        case SnakeMoveResult::NONE:
+            break;
+        case SnakeMoveResult::MOVE:
+            moveSnake(snake, move.pos, color, false, chunk);
+            break;
+        case SnakeMoveResult::GROW:
+            // Collision with food, grow one tail.
+            moveSnake(snake, move.pos, color, true, chunk);
+            break;
+        case SnakeMoveResult::SHRINK:
         {
-            // Move tail to front.
-            snake.pieces.insert(snake.pieces.begin(), snake.pieces.back());
-            snake.pieces.pop_back();
+            // Remove our tail.
+            const Vector2i tailPos = snake.pieces.back();
+            gTileMap.setChunkData(
+                chunk, tailPos.x, tailPos.y, TileType::SNAKE_DEAD, color);
+
+            snake.pieces.popBack();
+            if (snake.pieces.empty())
+            {
+                snakeDeath(snake, chunk);
+                break;
+            }
+
+            moveSnake(snake, move.pos, color, false, chunk);
         }
+        break;
+        case SnakeMoveResult::DIE:
+            // Snake collision.
+            snakeDeath(snake, chunk);
+            break;
     }
+}
 
-    // Update the tile map based on our pieces.
-    moveSnakePiece(snake, 0, newPos, TileType::SNAKE_HEAD, color);
-    for (size_t i = 1; i < snake.pieces.size(); i++)
-    {
-        moveSnakePiece(snake, i, snake.pieces[i], TileType::SNAKE_TAIL, color);
-    }
+Snakes::Snakes()
+{
+    // The tile map may not be constructed yet, the chunks are sized by
+    // Game::setArena.
+    init(MAX_PLAYERS_DEFAULT, 0);
+}
 
-    // Picking up food replaces it with one.
-    if (replaceFood)
-    {
-        gGame.createFood();
-    }
+void Snakes::init(size_t maxSnakes, size_t chunkCount)
+{
+    assert(maxSnakes < INVALID_SNAKE_ID);
+
+    _snakes.clear();
+    _snakes.resize(maxSnakes);
+    _hash = 0;
+
+    _moves.assign(maxSnakes, SnakeMove{});
+    _chunks.assign(chunkCount, SnakeChunk{});
+    _targets.assign(maxSnakes, 0);
+}
+
+void Snakes::copyState(const Snakes& other)
+{
+    _snakes = other._snakes;
+    _hash = other._hash;
 }
 
 SnakeId Snakes::create(PlayerId playerId, int32_t x, int32_t y)
@@ -105,15 +195,17 @@ SnakeId Snakes::create(PlayerId playerId, int32_t x, int32_t y)
         Snake& snake = _snakes[id];
         if (snake.id == INVALID_SNAKE_ID)
         {
+            _hash ^= getSnakeKey(id, snake);
             snake.state = SnakeState::ALIVE;
-            snake.pieces.push_back({ x, y });
+            snake.pieces.pushBack({ x, y });
             snake.id = id;
             snake.playerId = playerId;
             snake.direction = DIR_NONE;
+            _hash ^= getSnakeKey(id, snake);
             res = id;
 
-            Color color = gPlayers.getColor(playerId);
-            gTileMap.setData(x, y, TileType::SNAKE_HEAD, color);
+            gTileMap.setData(
+                x, y, TileType::SNAKE_HEAD, getPlayerTileColor(playerId));
             break;
         }
     }
@@ -126,44 +218,149 @@ Snake& Snakes::getData(SnakeId id)
     return _snakes[id];
 }
 
+void Snakes::set(SnakeId id, const Snake& data)
+{
+    Snake& snake = _snakes[id];
+    _hash ^= getSnakeKey(id, snake);
+    snake = data;
+    _hash ^= getSnakeKey(id, snake);
+}
+
 void Snakes::remove(SnakeId id)
 {
     Snake& snake = _snakes[id];
+    _hash ^= getSnakeKey(id, snake);
     snake.id = INVALID_SNAKE_ID;
     snake.direction = DIR_NONE;
     for (auto& piece : snake.pieces)
     {
-        gTileMap.setData(piece.x, piece.y, TileType::NONE, COLOR_BG);
+        gTileMap.setData(
+            piece.x, piece.y, TileType::NONE, TILE_COLOR_BG);
     }
     snake.pieces.clear();
 }
 
+// All snakes move at the same time. Phase one plans every move against the
+// tile map from the start of the tick. Phase two hands each moving snake to
+// the map chunk of the cell it enters, every chunk then resolves snakes
+// heading into the same cell and applies the moves of its snakes. Writes that
+// cross a chunk border are exchanged at the end. Every cell is written by at
+// most one snake, so the result is the same no matter the thread count.
 void Snakes::update()
 {
-    size_t alive = 0;
-    size_t count = 0;
+    // Only allocates for instances swapped in from a snapshot, those do not
+    // carry the scratch data.
+    const size_t numSnakes = _snakes.size();
+    _moves.resize(numSnakes);
+    _targets.resize(numSnakes);
+    _chunks.resize(gTileMap.getChunkCount());
 
-    for (auto& snake : _snakes)
+    const size_t numJobs = (numSnakes + SNAKES_PER_JOB - 1) / SNAKES_PER_JOB;
+    gThreadPool.parallelFor(numJobs, [this, numSnakes](size_t job) -> void {
+        const size_t start = job * SNAKES_PER_JOB;
+        const size_t end = std::min(start + SNAKES_PER_JOB, numSnakes);
+        for (size_t i = start; i < end; i++)
+        {
+            planMove(_snakes[i], _moves[i]);
+        }
+    });
+
+    // Bucket the moving snakes by chunk: count, turn the counts into start
+    // offsets and fill in slot order.
+    for (size_t i = 0; i < numSnakes; i++)
     {
-        if (snake.id == INVALID_SNAKE_ID)
+        const SnakeMove& move = _moves[i];
+        if (move.result == SnakeMoveResult::NONE)
             continue;
 
-        count++;
+        _chunks[move.cell / TILE_CHUNK_CELLS].count++;
+    }
+
+    uint32_t first = 0;
+    for (auto& chunk : _chunks)
+    {
+        chunk.first = first;
+        first += chunk.count;
+        chunk.count = 0;
+    }
 
-        if (snake.state != SnakeState::ALIVE)
+    for (size_t i = 0; i < numSnakes; i++)
+    {
+        const SnakeMove& move = _moves[i];
+        if (move.result == SnakeMoveResult::NONE)
             continue;
 
-        updateSnake(snake);
+        SnakeChunk& chunk = _chunks[move.cell / TILE_CHUNK_CELLS];
+        _targets[chunk.first + chunk.count++]
+            = (static_cast<uint64_t>(move.cell) << 16) | i;
+    }
+
+    gThreadPool.parallelFor(_chunks.size(), [this](size_t chunk) -> void {
+        updateChunk(chunk);
+    });
 
-        if (snake.state == SnakeState::ALIVE)
-            alive++;
+    gTileMap.flushChunks();
+
+    // Picking up food replaces it with one, placed after all moves so it
+    // can not land on a cell a snake is about to enter.
+    for (auto& chunk : _chunks)
+    {
+        for (uint32_t i = 0; i < chunk.foodEaten; i++)
+        {
+            gGame.createFood();
+        }
+        chunk.foodEaten = 0;
+
+        _hash ^= chunk.hashDelta;
+        chunk.hashDelta = 0;
+    }
+}
+
+void Snakes::updateChunk(size_t chunkIndex)
+{
+    SnakeChunk& chunk = _chunks[chunkIndex];
+    if (chunk.count == 0)
+        return;
+
+    uint64_t* targets = _targets.data() + chunk.first;
+    const size_t count = chunk.count;
+    chunk.count = 0;
+
+    // Sort by (cell, slot) to find snakes sharing a target cell, they are
+    // always in the same chunk.
+    std::sort(targets, targets + count);
+
+    for (size_t i = 1; i < count; i++)
+    {
+        if ((targets[i] >> 16) != (targets[i - 1] >> 16))
+            continue;
+
+        _moves[targets[i] & 0xFFFF].result = SnakeMoveResult::DIE;
+        _moves[targets[i - 1] & 0xFFFF].result = SnakeMoveResult::DIE;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const uint64_t target = targets[i];
+        const SnakeId slot = static_cast<SnakeId>(target & 0xFFFF);
+        const SnakeMove& move = _moves[slot];
+        Snake& snake = _snakes[slot];
+
+        chunk.hashDelta ^= getSnakeKey(slot, snake);
+        applyMove(snake, move, chunkIndex);
+        chunk.hashDelta ^= getSnakeKey(slot, snake);
+
+        if (move.result == SnakeMoveResult::GROW)
+            chunk.foodEaten++;
     }
 }
 
 void Snakes::setDirection(SnakeId id, const Vector2i& dir)
 {
     Snake& snake = _snakes[id];
+    _hash ^= getSnakeKey(id, snake);
     snake.direction = dir;
+    _hash ^= getSnakeKey(id, snake);
 }
 
 Vector2i Snakes::getDirection(SnakeId id) const
@@ -196,7 +393,12 @@ size_t Snakes::alive() const
     return res;
 }
 
-const std::array<Snake, MAX_PLAYERS>& Snakes::getSnakes() const
+size_t Snakes::capacity() const
+{
+    return _snakes.size();
+}
+
+const std::vector<Snake>& Snakes::getSnakes() const
 {
     return _snakes;
 }
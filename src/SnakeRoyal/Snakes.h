@@ -4,15 +4,61 @@
 #include "Config.h"
 #include "Snake.h"
 
+enum class SnakeMoveResult : uint8_t
+{
+    NONE = 0,
+    MOVE,
+    GROW,
+    SHRINK,
+    DIE,
+};
+
+// Planned move of a single snake for the current tick.
+struct SnakeMove
+{
+    SnakeMoveResult result = SnakeMoveResult::NONE;
+    Vector2i pos;
+    uint32_t cell = 0;
+};
+
+// Snakes entering cells of one tile map chunk this tick, their targets are
+// stored at [first, first + count) of Snakes::_targets.
+struct SnakeChunk
+{
+    uint32_t first = 0;
+    uint32_t count = 0;
+    uint32_t foodEaten = 0;
+    uint64_t hashDelta = 0;
+};
+
 class Snakes
 {
-    std::array<Snake, MAX_PLAYERS> _snakes;
+    std::vector<Snake> _snakes;
+
+    // Per tick scratch data, kept around to avoid allocations.
+    std::vector<SnakeMove> _moves;
+    std::vector<SnakeChunk> _chunks;
+
+    // (cell << 16) | slot of every moving snake, grouped by chunk.
+    std::vector<uint64_t> _targets;
+
+    // Zobrist hash over all snakes, free slots hash to 0.
+    uint64_t _hash = 0;
 
 public:
-    Snakes() = default;
+    Snakes();
+
+    // Resizes the snake slots and the scratch data for a tile map with
+    // chunkCount chunks, all snakes are removed.
+    void init(size_t maxSnakes, size_t chunkCount);
+
+    // Takes over the snakes of another instance without the scratch data,
+    // the bodies are copied into the ones already allocated.
+    void copyState(const Snakes& other);
 
     SnakeId create(PlayerId playerId, int32_t x, int32_t y);
     Snake& getData(SnakeId id);
+    void set(SnakeId id, const Snake& data);
     void remove(SnakeId id);
     void update();
     void setDirection(SnakeId id, const Vector2i& dir);
@@ -21,7 +67,17 @@ public:
     size_t count() const;
     size_t alive() const;
 
-    const std::array<Snake, MAX_PLAYERS>& getSnakes() const;
+    size_t capacity() const;
+
+    const std::vector<Snake>& getSnakes() const;
+
+    uint64_t getHash() const
+    {
+        return _hash;
+    }
+
+private:
+    void updateChunk(size_t chunkIndex);
 };
 
 extern Snakes gSnakes;
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include "Snapshot.h"
+
+#include <utility>
+
+Snapshots gSnapshots;
+
+void saveWorld(WorldSnapshot_t& snapshot)
+{
+    snapshot.valid = true;
+    snapshot.tick = gGame.getTick();
+    snapshot.hash = gGame.getTickHash();
+    snapshot.tileMap.copyState(gTileMap);
+    snapshot.snakes.copyState(gSnakes);
+    snapshot.players = gPlayers;
+    snapshot.randState = gGame.getRandState();
+    snapshot.roundData = gGame.getRoundData();
+}
+
+void loadWorld(const WorldSnapshot_t& snapshot)
+{
+    gGame.setTick(snapshot.tick);
+    gTileMap.copyState(snapshot.tileMap);
+    gSnakes.copyState(snapshot.snakes);
+    gPlayers.copyState(snapshot.players);
+    gGame.setRandState(snapshot.randState);
+    gGame.getRoundData() = snapshot.roundData;
+}
+
+void swapWorld(WorldSnapshot_t& snapshot)
+{
+    std::swap(gTileMap, snapshot.tileMap);
+    std::swap(gSnakes, snapshot.snakes);
+    std::swap(gPlayers, snapshot.players);
+    std::swap(gGame.getRoundData(), snapshot.roundData);
+
+    const uint32_t tick = gGame.getTick();
+    gGame.setTick(snapshot.tick);
+    snapshot.tick = tick;
+
+    const uint32_t randState = gGame.getRandState();
+    gGame.setRandState(snapshot.randState);
+    snapshot.randState = randState;
+}
+
+void Snapshots::save()
+{
+    const uint32_t tick = gGame.getTick();
+    saveWorld(_snapshots[tick % _snapshots.size()]);
+}
+
+bool Snapshots::restore(uint32_t tick)
+{
+    const WorldSnapshot_t& snapshot = _snapshots[tick % _snapshots.size()];
+    if (!snapshot.valid || snapshot.tick != tick)
+        return false;
+
+    loadWorld(snapshot);
+    return true;
+}
+
+bool Snapshots::getHash(uint32_t tick, uint64_t& hash) const
+{
+    const WorldSnapshot_t& snapshot = _snapshots[tick % _snapshots.size()];
+    if (!snapshot.valid || snapshot.tick != tick)
+        return false;
+
+    hash = snapshot.hash;
+    return true;
+}
+
+void Snapshots::clear()
+{
+    for (auto& snapshot : _snapshots)
+    {
+        snapshot.valid = false;
+    }
+}
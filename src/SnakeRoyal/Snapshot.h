@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <array>
+
+#include "Game.h"
+#include "Players.h"
+#include "Snakes.h"
+#include "TileMap.h"
+
+// Ticks a client keeps snapshots for, it simulates at most that many ticks
+// ahead of the last one the server sent.
+static constexpr uint32_t SNAPSHOT_TICKS = 16;
+
+// Everything the simulation reads and writes.
+struct WorldSnapshot_t
+{
+    bool valid = false;
+    uint32_t tick = 0;
+
+    // State hash at the start of the tick, before its events.
+    uint64_t hash = 0;
+
+    TileMap tileMap;
+    Snakes snakes;
+    Players players;
+    uint32_t randState = 0;
+    RoundData_t roundData;
+};
+
+// Copy the world into the snapshot and back. Only the state is copied, into
+// the storage the other side already has, so neither allocates once both
+// are of the same arena. Loading keeps the local input, see
+// Players::copyState.
+void saveWorld(WorldSnapshot_t& snapshot);
+void loadWorld(const WorldSnapshot_t& snapshot);
+
+// Exchanges the world with the snapshot, nothing is copied.
+void swapWorld(WorldSnapshot_t& snapshot);
+
+// Snapshots of the last ticks a client simulated ahead of the server, the
+// world goes back to one of them once the events of that tick arrive.
+class Snapshots
+{
+    std::array<WorldSnapshot_t, SNAPSHOT_TICKS> _snapshots;
+
+public:
+    // Saves the world as it is at the start of the current tick.
+    void save();
+
+    // Puts the world back to the start of the tick, false if there is no
+    // snapshot of it.
+    bool restore(uint32_t tick);
+
+    bool getHash(uint32_t tick, uint64_t& hash) const;
+
+    void clear();
+};
+
+extern Snapshots gSnapshots;
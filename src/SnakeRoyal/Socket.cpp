@@ -1,9 +1,13 @@
+#include <algorithm>
 #include <chrono>
 #include <cmath>
 #include <cstring>
+#include <deque>
 #include <future>
 #include <string>
 #include <thread>
+
+#ifdef _WIN32
 #include <winsock2.h>
 #include <ws2tcpip.h>
 
@@ -19,11 +23,41 @@
 #define SHUT_RDWR SD_BOTH
 #endif
 #define FLAG_NO_PIPE 0
+#else
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+using SOCKET = int32_t;
+#define SOCKET_ERROR -1
+#define INVALID_SOCKET -1
+#define LAST_SOCKET_ERROR() errno
+#define closesocket close
+#define FLAG_NO_PIPE MSG_NOSIGNAL
+#endif
 
 #include "Socket.h"
 
 static constexpr auto CONNECT_TIMEOUT = std::chrono::milliseconds(3000);
+#ifdef _WIN32
 static bool _wsaInitialised = false;
+#endif
 
 class SocketException : public std::runtime_error
 {
@@ -431,6 +465,73 @@ public:
         return totalSent;
     }
 
+    size_t SendDataVectored(const SocketSlice_t* slices, size_t count) override
+    {
+        if (_status != SocketStatus::CONNECTED)
+        {
+            throw std::runtime_error("Socket not connected.");
+        }
+
+        // Limit of slices passed per call, the rest goes in the next one.
+        static constexpr size_t MAX_SLICES = 64;
+
+        size_t totalSent = 0;
+        while (count > 0)
+        {
+            const size_t batch = std::min(count, MAX_SLICES);
+
+            size_t batchSize = 0;
+            size_t sentBytes = 0;
+#ifdef _WIN32
+            WSABUF buffers[MAX_SLICES];
+            for (size_t i = 0; i < batch; i++)
+            {
+                buffers[i].buf = (CHAR*)slices[i].data;
+                buffers[i].len = (ULONG)slices[i].size;
+                batchSize += slices[i].size;
+            }
+
+            DWORD bytesSent = 0;
+            if (WSASend(
+                    _socket, buffers, (DWORD)batch, &bytesSent, 0, nullptr,
+                    nullptr)
+                == SOCKET_ERROR)
+            {
+                return totalSent;
+            }
+            sentBytes = bytesSent;
+#else
+            iovec buffers[MAX_SLICES];
+            for (size_t i = 0; i < batch; i++)
+            {
+                buffers[i].iov_base = const_cast<void*>(slices[i].data);
+                buffers[i].iov_len = slices[i].size;
+                batchSize += slices[i].size;
+            }
+
+            msghdr msg{};
+            msg.msg_iov = buffers;
+            msg.msg_iovlen = batch;
+
+            const ssize_t res = sendmsg(_socket, &msg, FLAG_NO_PIPE);
+            if (res == SOCKET_ERROR)
+            {
+                return totalSent;
+            }
+            sentBytes = static_cast<size_t>(res);
+#endif
+            totalSent += sentBytes;
+            if (sentBytes < batchSize)
+            {
+                return totalSent;
+            }
+
+            slices += batch;
+            count -= batch;
+        }
+        return totalSent;
+    }
+
     SocketReadStatus ReceiveData(
         void* buffer, size_t size, size_t* sizeReceived) override
     {
@@ -478,6 +579,11 @@ public:
         return _hostName.empty() ? nullptr : _hostName.c_str();
     }
 
+    SOCKET GetSocket() const
+    {
+        return _socket;
+    }
+
 private:
     explicit TcpSocket(SOCKET socket, const std::string& hostName)
     {
@@ -497,8 +603,867 @@ private:
     }
 };
 
+// Non-blocking, a server binds one for all clients and each client connects
+// its own to the server.
+class UdpSocket final : public IUdpSocket, protected Socket
+{
+private:
+    // Limit of datagrams passed per call, the rest goes in the next one.
+    static constexpr size_t MAX_DATAGRAMS = 64;
+
+    // A server receives from every client on the one socket, the default
+    // buffers would overflow with a few hundred of them.
+    static constexpr int32_t BUFFER_SIZE = 1024 * 1024 * 4;
+
+    SOCKET _socket = INVALID_SOCKET;
+
+public:
+    UdpSocket() = default;
+
+    ~UdpSocket() override
+    {
+        CloseSocket();
+    }
+
+    bool Bind(const std::string& address, uint16_t port) override
+    {
+        sockaddr_storage ss{};
+        socklen_t ss_len;
+        if (!ResolveAddress(address, port, &ss, &ss_len)
+            || !CreateSocket(ss.ss_family))
+        {
+            return false;
+        }
+
+        // Turn off IPV6_V6ONLY so we can receive from v4 and v6 clients
+        int32_t value = 0;
+        setsockopt(
+            _socket, IPPROTO_IPV6, IPV6_V6ONLY, (const char*)&value,
+            sizeof(value));
+
+        if (bind(_socket, (sockaddr*)&ss, ss_len) != 0)
+        {
+            CloseSocket();
+            return false;
+        }
+        return true;
+    }
+
+    bool Connect(const std::string& address, uint16_t port) override
+    {
+        sockaddr_storage ss{};
+        socklen_t ss_len;
+        if (!ResolveAddress(address, port, &ss, &ss_len)
+            || !CreateSocket(ss.ss_family))
+        {
+            return false;
+        }
+
+        if (connect(_socket, (sockaddr*)&ss, ss_len) != 0)
+        {
+            CloseSocket();
+            return false;
+        }
+        return true;
+    }
+
+    size_t ReceiveMany(SocketDatagram_t* datagrams, size_t count) override
+    {
+        size_t received = 0;
+#ifdef __linux__
+        while (received < count)
+        {
+            const size_t batch = std::min(count - received, MAX_DATAGRAMS);
+
+            mmsghdr msgs[MAX_DATAGRAMS];
+            iovec buffers[MAX_DATAGRAMS];
+            for (size_t i = 0; i < batch; i++)
+            {
+                SocketDatagram_t& datagram = datagrams[received + i];
+                buffers[i].iov_base = datagram.data;
+                buffers[i].iov_len = datagram.size;
+
+                msgs[i] = mmsghdr{};
+                msgs[i].msg_hdr.msg_name = datagram.address.data;
+                msgs[i].msg_hdr.msg_namelen = sizeof(datagram.address.data);
+                msgs[i].msg_hdr.msg_iov = &buffers[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+
+            const int32_t res = recvmmsg(
+                _socket, msgs, static_cast<uint32_t>(batch), MSG_DONTWAIT,
+                nullptr);
+            if (res <= 0)
+                break;
+
+            for (int32_t i = 0; i < res; i++)
+            {
+                SocketDatagram_t& datagram = datagrams[received + i];
+                datagram.size = msgs[i].msg_len;
+                datagram.address.size = msgs[i].msg_hdr.msg_namelen;
+            }
+            received += res;
+
+            if (static_cast<size_t>(res) < batch)
+                break;
+        }
+#else
+        for (; received < count; received++)
+        {
+            SocketDatagram_t& datagram = datagrams[received];
+
+            socklen_t addressLen = sizeof(datagram.address.data);
+            const int32_t res = recvfrom(
+                _socket, (char*)datagram.data, (int32_t)datagram.size, 0,
+                (sockaddr*)datagram.address.data, &addressLen);
+            if (res == SOCKET_ERROR)
+                break;
+
+            datagram.size = static_cast<size_t>(res);
+            datagram.address.size = addressLen;
+        }
+#endif
+        return received;
+    }
+
+    size_t SendMany(const SocketDatagram_t* datagrams, size_t count) override
+    {
+        size_t sent = 0;
+#ifdef __linux__
+        while (sent < count)
+        {
+            const size_t batch = std::min(count - sent, MAX_DATAGRAMS);
+
+            mmsghdr msgs[MAX_DATAGRAMS];
+            iovec buffers[MAX_DATAGRAMS];
+            for (size_t i = 0; i < batch; i++)
+            {
+                const SocketDatagram_t& datagram = datagrams[sent + i];
+                buffers[i].iov_base = datagram.data;
+                buffers[i].iov_len = datagram.size;
+
+                msgs[i] = mmsghdr{};
+                if (datagram.address.size > 0)
+                {
+                    msgs[i].msg_hdr.msg_name = const_cast<uint8_t*>(
+                        datagram.address.data);
+                    msgs[i].msg_hdr.msg_namelen = datagram.address.size;
+                }
+                msgs[i].msg_hdr.msg_iov = &buffers[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+
+            const int32_t res = sendmmsg(
+                _socket, msgs, static_cast<uint32_t>(batch), FLAG_NO_PIPE);
+            if (res <= 0)
+                break;
+
+            sent += res;
+            if (static_cast<size_t>(res) < batch)
+                break;
+        }
+#else
+        for (; sent < count; sent++)
+        {
+            const SocketDatagram_t& datagram = datagrams[sent];
+
+            int32_t res;
+            if (datagram.address.size > 0)
+            {
+                res = sendto(
+                    _socket, (const char*)datagram.data,
+                    (int32_t)datagram.size, FLAG_NO_PIPE,
+                    (const sockaddr*)datagram.address.data,
+                    (socklen_t)datagram.address.size);
+            }
+            else
+            {
+                res = send(
+                    _socket, (const char*)datagram.data,
+                    (int32_t)datagram.size, FLAG_NO_PIPE);
+            }
+            if (res == SOCKET_ERROR)
+                break;
+        }
+#endif
+        return sent;
+    }
+
+    SOCKET GetSocket() const
+    {
+        return _socket;
+    }
+
+private:
+    bool CreateSocket(int32_t family)
+    {
+        CloseSocket();
+
+        _socket = socket(family, SOCK_DGRAM, IPPROTO_UDP);
+        if (_socket == INVALID_SOCKET)
+            return false;
+
+        int32_t size = BUFFER_SIZE;
+        setsockopt(
+            _socket, SOL_SOCKET, SO_RCVBUF, (const char*)&size, sizeof(size));
+        setsockopt(
+            _socket, SOL_SOCKET, SO_SNDBUF, (const char*)&size, sizeof(size));
+
+        if (!SetNonBlocking(_socket, true))
+        {
+            CloseSocket();
+            return false;
+        }
+        return true;
+    }
+
+    void CloseSocket()
+    {
+        if (_socket != INVALID_SOCKET)
+        {
+            closesocket(_socket);
+            _socket = INVALID_SOCKET;
+        }
+    }
+};
+
+#ifdef __linux__
+// Level triggered, a socket that was not read empty stays ready.
+class EpollSocketPoller final : public ISocketPoller
+{
+private:
+    int32_t _epoll = -1;
+    std::vector<epoll_event> _events;
+
+    // Registered with the poller itself as user data, see Wake.
+    int32_t _wakeEvent = -1;
+
+public:
+    EpollSocketPoller()
+    {
+        _epoll = epoll_create1(EPOLL_CLOEXEC);
+        if (_epoll == -1)
+        {
+            throw SocketException("Unable to create epoll instance.");
+        }
+        _events.resize(64);
+
+        _wakeEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = this;
+        if (_wakeEvent == -1
+            || epoll_ctl(_epoll, EPOLL_CTL_ADD, _wakeEvent, &ev) != 0)
+        {
+            if (_wakeEvent != -1)
+                close(_wakeEvent);
+            close(_epoll);
+            throw SocketException("Unable to create wake event.");
+        }
+    }
+
+    ~EpollSocketPoller() override
+    {
+        close(_wakeEvent);
+        close(_epoll);
+    }
+
+    bool Add(ITcpSocket* socket, void* userData) override
+    {
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = userData;
+        return epoll_ctl(
+                   _epoll, EPOLL_CTL_ADD,
+                   static_cast<TcpSocket*>(socket)->GetSocket(), &ev)
+               == 0;
+    }
+
+    bool Add(IUdpSocket* socket, void* userData) override
+    {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = userData;
+        return epoll_ctl(
+                   _epoll, EPOLL_CTL_ADD,
+                   static_cast<UdpSocket*>(socket)->GetSocket(), &ev)
+               == 0;
+    }
+
+    bool SetWriteInterest(
+        ITcpSocket* socket, void* userData, bool enabled) override
+    {
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        if (enabled)
+            ev.events |= EPOLLOUT;
+        ev.data.ptr = userData;
+        return epoll_ctl(
+                   _epoll, EPOLL_CTL_MOD,
+                   static_cast<TcpSocket*>(socket)->GetSocket(), &ev)
+               == 0;
+    }
+
+    void Remove(ITcpSocket* socket) override
+    {
+        epoll_ctl(
+            _epoll, EPOLL_CTL_DEL,
+            static_cast<TcpSocket*>(socket)->GetSocket(), nullptr);
+    }
+
+    size_t Wait(
+        int32_t timeoutMs, std::vector<SocketReady_t>& ready) override
+    {
+        int32_t count = epoll_wait(
+            _epoll, _events.data(), static_cast<int32_t>(_events.size()),
+            timeoutMs);
+        if (count <= 0)
+        {
+            return 0;
+        }
+        size_t found = 0;
+        for (int32_t i = 0; i < count; i++)
+        {
+            const uint32_t events = _events[i].events;
+
+            // Only resets the wake counter, nothing to report.
+            if (_events[i].data.ptr == this)
+            {
+                eventfd_t value = 0;
+                eventfd_read(_wakeEvent, &value);
+                continue;
+            }
+
+            SocketReady_t entry{};
+            entry.userData = _events[i].data.ptr;
+            entry.readable = (events
+                              & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                             != 0;
+            entry.writable = (events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) != 0;
+            ready.push_back(entry);
+            found++;
+        }
+        // All slots used, there may be more ready next time.
+        if (static_cast<size_t>(count) == _events.size())
+        {
+            _events.resize(_events.size() * 2);
+        }
+        return found;
+    }
+
+    void Wake() override
+    {
+        eventfd_write(_wakeEvent, 1);
+    }
+};
+
+// Talks to io_uring with the plain system calls, the shared queues are
+// mapped once and filled without any call. Operations are referenced by
+// their slot in _ops, which also keeps the iovecs of sends alive.
+class UringSocketRing final : public ISocketRing
+{
+private:
+    struct Op_t
+    {
+        void* userData = nullptr;
+        SocketRingOp op = SocketRingOp::RECEIVE;
+        SOCKET socket = INVALID_SOCKET;
+        msghdr msg{};
+        std::vector<iovec> iov;
+    };
+
+    int32_t _ring = -1;
+
+    void* _sqRing = MAP_FAILED;
+    size_t _sqRingSize = 0;
+    void* _cqRing = MAP_FAILED;
+    size_t _cqRingSize = 0;
+    io_uring_sqe* _sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t _sqesSize = 0;
+
+    uint32_t* _sqHead = nullptr;
+    uint32_t* _sqTail = nullptr;
+    uint32_t* _sqFlags = nullptr;
+    uint32_t* _sqArray = nullptr;
+    uint32_t _sqMask = 0;
+    uint32_t _sqEntries = 0;
+
+    uint32_t* _cqHead = nullptr;
+    uint32_t* _cqTail = nullptr;
+    io_uring_cqe* _cqes = nullptr;
+    uint32_t _cqMask = 0;
+
+    // Entries written to the submission queue but not submitted yet.
+    uint32_t _queued = 0;
+
+    // A deque so a queued msghdr stays where the kernel expects it.
+    std::deque<Op_t> _ops;
+    std::vector<uint32_t> _freeOps;
+
+public:
+    ~UringSocketRing() override
+    {
+        if (_sqes != MAP_FAILED)
+            munmap(_sqes, _sqesSize);
+        if (_cqRing != MAP_FAILED && _cqRing != _sqRing)
+            munmap(_cqRing, _cqRingSize);
+        if (_sqRing != MAP_FAILED)
+            munmap(_sqRing, _sqRingSize);
+        if (_ring != -1)
+            close(_ring);
+    }
+
+    bool Initialize(uint32_t entries)
+    {
+        io_uring_params params{};
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = entries * 4;
+
+        _ring = static_cast<int32_t>(
+            syscall(__NR_io_uring_setup, entries, &params));
+        if (_ring == -1)
+            return false;
+
+        // Completions are never dropped and waits can time out.
+        static constexpr uint32_t REQUIRED_FEATURES = IORING_FEAT_NODROP
+                                                      | IORING_FEAT_EXT_ARG;
+        if ((params.features & REQUIRED_FEATURES) != REQUIRED_FEATURES)
+            return false;
+
+        _sqRingSize = params.sq_off.array
+                      + params.sq_entries * sizeof(uint32_t);
+        _cqRingSize = params.cq_off.cqes
+                      + params.cq_entries * sizeof(io_uring_cqe);
+        if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0)
+        {
+            _sqRingSize = std::max(_sqRingSize, _cqRingSize);
+            _cqRingSize = _sqRingSize;
+        }
+
+        _sqRing = mmap(
+            nullptr, _sqRingSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, _ring, IORING_OFF_SQ_RING);
+        if (_sqRing == MAP_FAILED)
+            return false;
+
+        if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0)
+        {
+            _cqRing = _sqRing;
+        }
+        else
+        {
+            _cqRing = mmap(
+                nullptr, _cqRingSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, _ring, IORING_OFF_CQ_RING);
+            if (_cqRing == MAP_FAILED)
+                return false;
+        }
+
+        _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        _sqes = static_cast<io_uring_sqe*>(mmap(
+            nullptr, _sqesSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, _ring, IORING_OFF_SQES));
+        if (_sqes == MAP_FAILED)
+            return false;
+
+        uint8_t* sq = static_cast<uint8_t*>(_sqRing);
+        _sqHead = reinterpret_cast<uint32_t*>(sq + params.sq_off.head);
+        _sqTail = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+        _sqFlags = reinterpret_cast<uint32_t*>(sq + params.sq_off.flags);
+        _sqArray = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+        _sqMask = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+        _sqEntries = params.sq_entries;
+
+        uint8_t* cq = static_cast<uint8_t*>(_cqRing);
+        _cqHead = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+        _cqTail = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+        _cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        _cqMask = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+
+        return true;
+    }
+
+    bool QueueReceive(
+        ITcpSocket* socket, void* buffer, size_t size, void* userData) override
+    {
+        const uint32_t slot = AllocOp(socket, SocketRingOp::RECEIVE, userData);
+
+        io_uring_sqe* sqe = GetSqe();
+        if (sqe == nullptr)
+        {
+            _freeOps.push_back(slot);
+            return false;
+        }
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = _ops[slot].socket;
+        sqe->addr = reinterpret_cast<uint64_t>(buffer);
+        sqe->len = static_cast<uint32_t>(size);
+        sqe->user_data = slot;
+        return true;
+    }
+
+    bool QueueSend(
+        ITcpSocket* socket, const SocketSlice_t* slices, size_t count,
+        void* userData) override
+    {
+        const uint32_t slot = AllocOp(socket, SocketRingOp::SEND, userData);
+
+        Op_t& op = _ops[slot];
+        op.iov.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            op.iov[i].iov_base = const_cast<void*>(slices[i].data);
+            op.iov[i].iov_len = slices[i].size;
+        }
+
+        if (!QueueSendMsg(slot))
+        {
+            _freeOps.push_back(slot);
+            return false;
+        }
+        return true;
+    }
+
+    bool QueuePoll(ITcpSocket* socket, void* userData) override
+    {
+        const uint32_t slot = AllocOp(socket, SocketRingOp::POLL, userData);
+
+        io_uring_sqe* sqe = GetSqe();
+        if (sqe == nullptr)
+        {
+            _freeOps.push_back(slot);
+            return false;
+        }
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = _ops[slot].socket;
+        sqe->poll32_events = POLLIN;
+        sqe->user_data = slot;
+        return true;
+    }
+
+    size_t Submit(
+        int32_t timeoutMs,
+        std::vector<SocketCompletion_t>& completions) override
+    {
+        size_t found = Reap(completions);
+
+        // Nothing to hand over and nothing to wait for, no call needed.
+        const bool overflow = (__atomic_load_n(_sqFlags, __ATOMIC_ACQUIRE)
+                               & IORING_SQ_CQ_OVERFLOW)
+                              != 0;
+        if (_queued == 0 && !overflow && (timeoutMs == 0 || found > 0))
+            return found;
+
+        const uint32_t waitFor = (timeoutMs != 0 && found == 0) ? 1 : 0;
+        Enter(waitFor, timeoutMs);
+
+        return found + Reap(completions);
+    }
+
+private:
+    uint32_t AllocOp(ITcpSocket* socket, SocketRingOp type, void* userData)
+    {
+        uint32_t slot;
+        if (_freeOps.empty())
+        {
+            slot = static_cast<uint32_t>(_ops.size());
+            _ops.emplace_back();
+        }
+        else
+        {
+            slot = _freeOps.back();
+            _freeOps.pop_back();
+        }
+
+        Op_t& op = _ops[slot];
+        op.userData = userData;
+        op.op = type;
+        op.socket = static_cast<TcpSocket*>(socket)->GetSocket();
+        return slot;
+    }
+
+    bool QueueSendMsg(uint32_t slot)
+    {
+        io_uring_sqe* sqe = GetSqe();
+        if (sqe == nullptr)
+            return false;
+
+        Op_t& op = _ops[slot];
+        op.msg = msghdr{};
+        op.msg.msg_iov = op.iov.data();
+        op.msg.msg_iovlen = op.iov.size();
+
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = op.socket;
+        sqe->addr = reinterpret_cast<uint64_t>(&op.msg);
+        sqe->len = 1;
+        sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+        sqe->user_data = slot;
+        return true;
+    }
+
+    io_uring_sqe* GetSqe()
+    {
+        const uint32_t tail = *_sqTail;
+        if (tail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) >= _sqEntries)
+        {
+            // Full, hand over what is there to make room.
+            if (!Enter(0, 0))
+                return nullptr;
+        }
+
+        const uint32_t index = tail & _sqMask;
+        io_uring_sqe* sqe = &_sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        _sqArray[index] = index;
+        __atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+        _queued++;
+        return sqe;
+    }
+
+    bool Enter(uint32_t waitFor, int32_t timeoutMs)
+    {
+        uint32_t flags = 0;
+        if (waitFor > 0 || (__atomic_load_n(_sqFlags, __ATOMIC_ACQUIRE)
+                            & IORING_SQ_CQ_OVERFLOW)
+                               != 0)
+        {
+            flags |= IORING_ENTER_GETEVENTS;
+        }
+
+        __kernel_timespec ts{};
+        io_uring_getevents_arg arg{};
+        const void* argPtr = nullptr;
+        size_t argSize = 0;
+        if (waitFor > 0 && timeoutMs > 0)
+        {
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+            arg.sigmask_sz = _NSIG / 8;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+            argPtr = &arg;
+            argSize = sizeof(arg);
+            flags |= IORING_ENTER_EXT_ARG;
+        }
+
+        const long res = syscall(
+            __NR_io_uring_enter, _ring, _queued, waitFor, flags, argPtr,
+            argSize);
+        if (res < 0)
+        {
+            // Timeouts and signals are fine, what was queued stays queued.
+            return errno == ETIME || errno == EINTR;
+        }
+        _queued -= std::min(_queued, static_cast<uint32_t>(res));
+        return true;
+    }
+
+    size_t Reap(std::vector<SocketCompletion_t>& completions)
+    {
+        size_t found = 0;
+        uint32_t head = *_cqHead;
+        const uint32_t tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++)
+        {
+            const io_uring_cqe& cqe = _cqes[head & _cqMask];
+            const uint32_t slot = static_cast<uint32_t>(cqe.user_data);
+            const int32_t res = cqe.res;
+
+            Op_t& op = _ops[slot];
+            if (op.op == SocketRingOp::SEND && res > 0 && Advance(op, res))
+            {
+                // Only part went out, the rest is queued again.
+                if (QueueSendMsg(slot))
+                    continue;
+            }
+
+            SocketCompletion_t completion{};
+            completion.userData = op.userData;
+            completion.op = op.op;
+            completion.success = op.op == SocketRingOp::RECEIVE ? res > 0
+                                                                : res >= 0;
+            completion.size = res > 0 ? static_cast<size_t>(res) : 0;
+            completions.push_back(completion);
+            found++;
+
+            op.iov.clear();
+            _freeOps.push_back(slot);
+        }
+        __atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+        return found;
+    }
+
+    // Skips the sent bytes, returns true if some are left.
+    static bool Advance(Op_t& op, int32_t sent)
+    {
+        size_t left = static_cast<size_t>(sent);
+        size_t first = 0;
+        while (first < op.iov.size() && left >= op.iov[first].iov_len)
+        {
+            left -= op.iov[first].iov_len;
+            first++;
+        }
+        op.iov.erase(op.iov.begin(), op.iov.begin() + first);
+        if (op.iov.empty())
+            return false;
+
+        op.iov[0].iov_base = static_cast<uint8_t*>(op.iov[0].iov_base) + left;
+        op.iov[0].iov_len -= left;
+        return true;
+    }
+};
+#else
+class PollSocketPoller final : public ISocketPoller, protected Socket
+{
+private:
+    // The first entry is the wake socket.
+    std::vector<pollfd> _fds;
+    std::vector<void*> _userData;
+
+    // UDP socket connected to itself, Wake sends it a byte.
+    SOCKET _wakeSocket = INVALID_SOCKET;
+
+public:
+    PollSocketPoller()
+    {
+        _wakeSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addrLen = sizeof(addr);
+
+        if (_wakeSocket == INVALID_SOCKET
+            || bind(_wakeSocket, (sockaddr*)&addr, sizeof(addr)) != 0
+            || getsockname(_wakeSocket, (sockaddr*)&addr, &addrLen) != 0
+            || connect(_wakeSocket, (sockaddr*)&addr, addrLen) != 0
+            || !SetNonBlocking(_wakeSocket, true))
+        {
+            if (_wakeSocket != INVALID_SOCKET)
+                closesocket(_wakeSocket);
+            throw SocketException("Unable to create wake socket.");
+        }
+
+        pollfd pfd{};
+        pfd.fd = _wakeSocket;
+        pfd.events = POLLIN;
+        _fds.push_back(pfd);
+        _userData.push_back(nullptr);
+    }
+
+    ~PollSocketPoller() override
+    {
+        closesocket(_wakeSocket);
+    }
+
+    bool Add(ITcpSocket* socket, void* userData) override
+    {
+        pollfd pfd{};
+        pfd.fd = static_cast<TcpSocket*>(socket)->GetSocket();
+        pfd.events = POLLIN;
+        _fds.push_back(pfd);
+        _userData.push_back(userData);
+        return true;
+    }
+
+    bool Add(IUdpSocket* socket, void* userData) override
+    {
+        pollfd pfd{};
+        pfd.fd = static_cast<UdpSocket*>(socket)->GetSocket();
+        pfd.events = POLLIN;
+        _fds.push_back(pfd);
+        _userData.push_back(userData);
+        return true;
+    }
+
+    void Remove(ITcpSocket* socket) override
+    {
+        const size_t index = Find(socket);
+        if (index == _fds.size())
+            return;
+
+        _fds[index] = _fds.back();
+        _fds.pop_back();
+        _userData[index] = _userData.back();
+        _userData.pop_back();
+    }
+
+    bool SetWriteInterest(
+        ITcpSocket* socket, void* userData, bool enabled) override
+    {
+        const size_t index = Find(socket);
+        if (index == _fds.size())
+            return false;
+
+        _fds[index].events = enabled ? (POLLIN | POLLOUT) : POLLIN;
+        _userData[index] = userData;
+        return true;
+    }
+
+    size_t Wait(
+        int32_t timeoutMs, std::vector<SocketReady_t>& ready) override
+    {
+#ifdef _WIN32
+        int32_t count = WSAPoll(
+            _fds.data(), static_cast<ULONG>(_fds.size()), timeoutMs);
+#else
+        int32_t count = poll(
+            _fds.data(), static_cast<nfds_t>(_fds.size()), timeoutMs);
+#endif
+        if (count <= 0)
+        {
+            return 0;
+        }
+        // Only drained, nothing to report.
+        if (_fds[0].revents != 0)
+        {
+            char data[64];
+            while (recv(_wakeSocket, data, sizeof(data), 0) > 0)
+            {
+            }
+        }
+
+        size_t found = 0;
+        for (size_t i = 1; i < _fds.size(); i++)
+        {
+            const short revents = _fds[i].revents;
+            if (revents == 0)
+                continue;
+
+            SocketReady_t entry{};
+            entry.userData = _userData[i];
+            entry.readable = (revents & (POLLIN | POLLHUP | POLLERR)) != 0;
+            entry.writable = (revents & (POLLOUT | POLLHUP | POLLERR)) != 0;
+            ready.push_back(entry);
+            found++;
+        }
+        return found;
+    }
+
+    void Wake() override
+    {
+        const char data = 0;
+        send(_wakeSocket, &data, sizeof(data), 0);
+    }
+
+private:
+    size_t Find(ITcpSocket* socket) const
+    {
+        const SOCKET fd = static_cast<TcpSocket*>(socket)->GetSocket();
+        for (size_t i = 1; i < _fds.size(); i++)
+        {
+            if (_fds[i].fd == fd)
+                return i;
+        }
+        return _fds.size();
+    }
+};
+#endif
+
 bool InitializeWSA()
 {
+#ifdef _WIN32
     if (!_wsaInitialised)
     {
         WSADATA wsa_data{};
@@ -510,18 +1475,62 @@ bool InitializeWSA()
         _wsaInitialised = true;
     }
     return _wsaInitialised;
+#else
+    return true;
+#endif
 }
 
 void DisposeWSA()
 {
+#ifdef _WIN32
     if (_wsaInitialised)
     {
         WSACleanup();
         _wsaInitialised = false;
     }
+#endif
 }
 
 std::unique_ptr<ITcpSocket> CreateTcpSocket()
 {
     return std::make_unique<TcpSocket>();
 }
+
+std::unique_ptr<IUdpSocket> CreateUdpSocket()
+{
+    return std::make_unique<UdpSocket>();
+}
+
+std::string GetSocketAddressName(const SocketAddress_t& address)
+{
+    char hostName[NI_MAXHOST];
+    char serviceName[NI_MAXSERV];
+    if (getnameinfo(
+            (const sockaddr*)address.data, (socklen_t)address.size, hostName,
+            sizeof(hostName), serviceName, sizeof(serviceName),
+            NI_NUMERICHOST | NI_NUMERICSERV)
+        != 0)
+    {
+        return std::string();
+    }
+    return std::string(hostName) + ":" + serviceName;
+}
+
+std::unique_ptr<ISocketPoller> CreateSocketPoller()
+{
+#ifdef __linux__
+    return std::make_unique<EpollSocketPoller>();
+#else
+    return std::make_unique<PollSocketPoller>();
+#endif
+}
+
+std::unique_ptr<ISocketRing> CreateSocketRing(uint32_t entries)
+{
+#ifdef __linux__
+    auto ring = std::make_unique<UringSocketRing>();
+    if (ring->Initialize(entries))
+        return ring;
+#endif
+    return nullptr;
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <string.h>
 #include <memory>
 #include <string>
 #include <vector>
@@ -20,32 +21,184 @@ enum class SocketReadStatus
     DISCONNECTED,
 };
 
+// One piece of a vectored send.
+struct SocketSlice_t
+{
+    const void* data;
+    size_t size;
+};
+
 class ITcpSocket
 {
 public:
     virtual ~ITcpSocket() = default;
 
-    virtual SocketStatus GetStatus() const abstract;
-    virtual const char* GetError() const abstract;
-    virtual const char* GetHostName() const abstract;
+    virtual SocketStatus GetStatus() const = 0;
+    virtual const char* GetError() const = 0;
+    virtual const char* GetHostName() const = 0;
 
-    virtual void Listen(uint16_t port) abstract;
-    virtual void Listen(const std::string& address, uint16_t port) abstract;
-    virtual std::unique_ptr<ITcpSocket> Accept() abstract;
+    virtual void Listen(uint16_t port) = 0;
+    virtual void Listen(const std::string& address, uint16_t port) = 0;
+    virtual std::unique_ptr<ITcpSocket> Accept() = 0;
 
-    virtual void Connect(const std::string& address, uint16_t port) abstract;
+    virtual void Connect(const std::string& address, uint16_t port) = 0;
     virtual void ConnectAsync(
-        const std::string& address, uint16_t port) abstract;
+        const std::string& address, uint16_t port) = 0;
+
+    virtual size_t SendData(const void* buffer, size_t size) = 0;
 
-    virtual size_t SendData(const void* buffer, size_t size) abstract;
+    // Sends the slices in order with as few calls as possible, returns how
+    // many bytes went out before the socket would block.
+    virtual size_t SendDataVectored(
+        const SocketSlice_t* slices, size_t count) = 0;
     virtual SocketReadStatus ReceiveData(
-        void* buffer, size_t size, size_t* sizeReceived) abstract;
+        void* buffer, size_t size, size_t* sizeReceived) = 0;
+
+    virtual void Disconnect() = 0;
+    virtual void Close() = 0;
+};
+
+// Where a datagram came from or goes to, big enough for any address family.
+// Compared bytewise so it can be used as a key.
+struct SocketAddress_t
+{
+    uint32_t size = 0;
+    alignas(8) uint8_t data[128];
+
+    bool operator==(const SocketAddress_t& other) const
+    {
+        return size == other.size && memcmp(data, other.data, size) == 0;
+    }
+
+    bool operator<(const SocketAddress_t& other) const
+    {
+        if (size != other.size)
+            return size < other.size;
+        return memcmp(data, other.data, size) < 0;
+    }
+};
+
+struct SocketDatagram_t
+{
+    // Ignored when sending on a connected socket.
+    SocketAddress_t address;
 
-    virtual void Disconnect() abstract;
-    virtual void Close() abstract;
+    // Received into up to size bytes, size is then what arrived.
+    uint8_t* data;
+    size_t size;
+};
+
+class IUdpSocket
+{
+public:
+    virtual ~IUdpSocket() = default;
+
+    // Receives from anyone on the address and port.
+    virtual bool Bind(const std::string& address, uint16_t port) = 0;
+
+    // Resolves right away, only the peer is received from after this and
+    // everything goes to it.
+    virtual bool Connect(const std::string& address, uint16_t port) = 0;
+
+    // Receives as many of the datagrams as are waiting without blocking,
+    // returns how many. Batched into one call where the platform can.
+    virtual size_t ReceiveMany(SocketDatagram_t* datagrams, size_t count) = 0;
+
+    // Sends the datagrams in order, returns how many went out before the
+    // socket would block. The rest is dropped like any lost datagram.
+    virtual size_t SendMany(
+        const SocketDatagram_t* datagrams, size_t count) = 0;
+};
+
+struct SocketReady_t
+{
+    void* userData;
+    bool readable;
+    bool writable;
+};
+
+// Tells which of the added sockets can be read from without blocking, a
+// closed or failed socket counts as readable so the read notices it. Epoll
+// on Linux, poll everywhere else.
+class ISocketPoller
+{
+public:
+    virtual ~ISocketPoller() = default;
+
+    // The user data is handed back by Wait whenever the socket is ready.
+    virtual bool Add(ITcpSocket* socket, void* userData) = 0;
+    virtual bool Add(IUdpSocket* socket, void* userData) = 0;
+    virtual void Remove(ITcpSocket* socket) = 0;
+
+    // Also reports the socket once it can be written to, only wanted while
+    // something is waiting to be sent.
+    virtual bool SetWriteInterest(
+        ITcpSocket* socket, void* userData, bool enabled) = 0;
+
+    // Appends the ready sockets, waits up to timeoutMs for one to become
+    // ready, 0 returns right away and -1 waits forever.
+    virtual size_t Wait(
+        int32_t timeoutMs, std::vector<SocketReady_t>& ready) = 0;
+
+    // Makes a Wait on another thread return, or the next one if none is
+    // waiting right now. Safe to call from any thread.
+    virtual void Wake() = 0;
+};
+
+enum class SocketRingOp
+{
+    RECEIVE,
+    SEND,
+    POLL,
+};
+
+struct SocketCompletion_t
+{
+    void* userData;
+    SocketRingOp op;
+
+    // Bytes received or sent, 0 if the socket failed or was closed.
+    size_t size;
+    bool success;
+};
+
+// Queues receives and sends of many sockets and hands all of them to the
+// kernel with one call, completions come back the same way. Buffers belong
+// to the kernel until their operation completed. io_uring on Linux, there
+// is none on other platforms.
+class ISocketRing
+{
+public:
+    virtual ~ISocketRing() = default;
+
+    virtual bool QueueReceive(
+        ITcpSocket* socket, void* buffer, size_t size, void* userData) = 0;
+
+    // Completes once all slices were sent or the socket failed, the slice
+    // list itself is copied.
+    virtual bool QueueSend(
+        ITcpSocket* socket, const SocketSlice_t* slices, size_t count,
+        void* userData) = 0;
+
+    // Completes once the socket is readable, for listening sockets.
+    virtual bool QueuePoll(ITcpSocket* socket, void* userData) = 0;
+
+    // Submits everything queued and appends what completed. Waits up to
+    // timeoutMs for the first completion, 0 returns right away and -1
+    // waits forever.
+    virtual size_t Submit(
+        int32_t timeoutMs, std::vector<SocketCompletion_t>& completions) = 0;
 };
 
 bool InitializeWSA();
 void DisposeWSA();
 
 std::unique_ptr<ITcpSocket> CreateTcpSocket();
+std::unique_ptr<IUdpSocket> CreateUdpSocket();
+
+// Numeric host and port, for logging.
+std::string GetSocketAddressName(const SocketAddress_t& address);
+std::unique_ptr<ISocketPoller> CreateSocketPoller();
+
+// Returns nullptr if the platform or the kernel has no support.
+std::unique_ptr<ISocketRing> CreateSocketRing(uint32_t entries);
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+// Bounded queue between exactly one producer and one consumer thread,
+// neither side locks or waits. Items are moved in and out, the slots of
+// popped items are reused.
+template<typename T> class SpscQueue
+{
+    std::vector<T> _items;
+    size_t _mask = 0;
+
+    // Only the consumer moves the head and only the producer the tail, each
+    // on its own cache line.
+    alignas(64) std::atomic<size_t> _head{ 0 };
+    alignas(64) std::atomic<size_t> _tail{ 0 };
+
+public:
+    // The capacity is rounded up to a power of two.
+    explicit SpscQueue(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+        {
+            size *= 2;
+        }
+        _items.resize(size);
+        _mask = size - 1;
+    }
+
+    // Producer only, returns false and leaves the item alone if full.
+    bool tryPush(T& item)
+    {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head.load(std::memory_order_acquire) == _items.size())
+            return false;
+
+        _items[tail & _mask] = std::move(item);
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only, returns false if empty.
+    bool tryPop(T& item)
+    {
+        const size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire))
+            return false;
+
+        item = std::move(_items[head & _mask]);
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+};
@@ -0,0 +1,108 @@
+#include "ThreadPool.h"
+
+ThreadPool gThreadPool;
+
+ThreadPool::~ThreadPool()
+{
+    shutdown();
+}
+
+void ThreadPool::init(size_t numThreads)
+{
+    shutdown();
+
+    _quit = false;
+    for (size_t i = 1; i < numThreads; i++)
+    {
+        _threads.emplace_back(&ThreadPool::workerMain, this, _generation);
+    }
+}
+
+void ThreadPool::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quit = true;
+    }
+    _wakeCond.notify_all();
+
+    for (auto& thread : _threads)
+    {
+        thread.join();
+    }
+    _threads.clear();
+}
+
+size_t ThreadPool::getThreadCount() const
+{
+    return _threads.size() + 1;
+}
+
+void ThreadPool::parallelFor(
+    size_t count, const std::function<void(size_t)>& fn)
+{
+    if (_threads.empty() || count <= 1)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            fn(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _job = &fn;
+        _jobCount = count;
+        _nextJob = 0;
+        _busyWorkers = _threads.size();
+        _generation++;
+    }
+    _wakeCond.notify_all();
+
+    runJobs();
+
+    // Wait for every worker to leave the batch, not just for the jobs to be
+    // done, so no worker can still be looking at fn once we return.
+    std::unique_lock<std::mutex> lock(_mutex);
+    _doneCond.wait(lock, [this]() -> bool { return _busyWorkers == 0; });
+    _job = nullptr;
+}
+
+void ThreadPool::workerMain(uint64_t generation)
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wakeCond.wait(lock, [this, generation]() -> bool {
+                return _quit || _generation != generation;
+            });
+
+            if (_quit)
+                return;
+
+            generation = _generation;
+        }
+
+        runJobs();
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (--_busyWorkers == 0)
+                _doneCond.notify_all();
+        }
+    }
+}
+
+void ThreadPool::runJobs()
+{
+    while (true)
+    {
+        const size_t index = _nextJob.fetch_add(1);
+        if (index >= _jobCount)
+            break;
+
+        (*_job)(index);
+    }
+}
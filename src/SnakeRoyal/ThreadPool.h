@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+    std::vector<std::thread> _threads;
+
+    std::mutex _mutex;
+    std::condition_variable _wakeCond;
+    std::condition_variable _doneCond;
+
+    // Current batch, only modified while no worker is busy.
+    const std::function<void(size_t)>* _job = nullptr;
+    size_t _jobCount = 0;
+    std::atomic<size_t> _nextJob{ 0 };
+
+    uint64_t _generation = 0;
+    size_t _busyWorkers = 0;
+    bool _quit = false;
+
+public:
+    ThreadPool() = default;
+    ~ThreadPool();
+
+    // Starts numThreads - 1 workers, the thread calling parallelFor is the
+    // remaining one. 0 or 1 runs everything on the calling thread.
+    void init(size_t numThreads);
+    void shutdown();
+
+    size_t getThreadCount() const;
+
+    // Calls fn(i) for every i in [0, count) and returns once all calls are
+    // done. Calls may run in any order and on any thread, fn must only write
+    // state owned by index i.
+    void parallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+private:
+    void workerMain(uint64_t generation);
+    void runJobs();
+};
+
+extern ThreadPool gThreadPool;
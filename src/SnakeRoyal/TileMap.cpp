@@ -1,21 +1,113 @@
 #include "TileMap.h"
 #include "Game.h"
+#include "Utils.h"
 #include <assert.h>
+#include <algorithm>
 
 TileMap gTileMap;
 
+static constexpr Color TILE_PALETTE[] = {
+    COLOR_BG,
+    COLOR_GREY,
+    COLOR_ORANGE,
+};
+
+static_assert(std::size(TILE_PALETTE) == TILE_COLOR_PLAYER);
+
+// Largest power of two that is not above the Fenwick tree size.
+static constexpr size_t getFreeTreeStep(size_t size)
+{
+    size_t step = 1;
+    while ((step << 1) <= size)
+        step <<= 1;
+    return step;
+}
+
+static uint64_t getTileKey(size_t index, const TileData_t& data)
+{
+    if (data.type == TileType::NONE && data.color == TILE_COLOR_BG)
+        return 0;
+
+    return Utils::hash64(
+        (static_cast<uint64_t>(index) << 16)
+        | (static_cast<uint64_t>(data.type) << 8) | data.color);
+}
+
+Color getTileColor(uint8_t color)
+{
+    if (color < TILE_COLOR_PLAYER)
+        return TILE_PALETTE[color];
+
+    return COLOR_PLAYER_PALETTE[color - TILE_COLOR_PLAYER];
+}
+
+TileMap::TileMap()
+{
+    init(TILE_MAP_GRID_W_DEFAULT, TILE_MAP_GRID_H_DEFAULT);
+}
+
+void TileMap::init(int32_t width, int32_t height)
+{
+    assert(width > 0 && width <= TILE_MAP_GRID_MAX);
+    assert(height > 0 && height <= TILE_MAP_GRID_MAX);
+
+    _width = width;
+    _height = height;
+
+    const size_t size = static_cast<size_t>(width) * height;
+    const size_t words = (size + 63) / 64;
+
+    _tiles.assign(size, TileData_t{});
+    _freeBits.assign(words, 0);
+    _freeTree.assign(words + 1, 0);
+    _freeTreeStep = getFreeTreeStep(words);
+
+    _chunks.clear();
+    _chunks.resize((size + TILE_CHUNK_CELLS - 1) / TILE_CHUNK_CELLS);
+    for (auto& chunkData : _chunks)
+    {
+        chunkData.outbox.reserve(TILE_CHUNK_OUTBOX);
+    }
+
+    rebuildFreeCells();
+    rebuildHash();
+}
+
+void TileMap::copyState(const TileMap& other)
+{
+    _width = other._width;
+    _height = other._height;
+    _tiles = other._tiles;
+    _freeBits = other._freeBits;
+    _freeTree = other._freeTree;
+    _freeTreeStep = other._freeTreeStep;
+    _freeCount = other._freeCount;
+    _hash = other._hash;
+
+    _chunks.resize(other._chunks.size());
+}
+
 void TileMap::draw(Painter& painter)
 {
     painter.rect(
         TILE_MAP_MARGIN_LEFT - 1, TILE_MAP_MARGIN_TOP - 1, TILE_MAP_SIZE_W + 2,
         TILE_MAP_SIZE_H + 2, { 0, 255, 0 });
 
-    for (int32_t x = 0; x < TILE_MAP_GRID_W; x++)
+    // Arenas bigger than the default shrink the tiles, anything that does
+    // not fit with 1 pixel tiles is cut off.
+    const int32_t pitchX = std::max(1, TILE_MAP_SIZE_W / _width);
+    const int32_t pitchY = std::max(1, TILE_MAP_SIZE_H / _height);
+    const int32_t tileW = std::max(1, pitchX - 1);
+    const int32_t tileH = std::max(1, pitchY - 1);
+    const int32_t visibleW = std::min(_width, TILE_MAP_SIZE_W / pitchX);
+    const int32_t visibleH = std::min(_height, TILE_MAP_SIZE_H / pitchY);
+
+    for (int32_t x = 0; x < visibleW; x++)
     {
-        int32_t xx = x * (TILE_SIZE_W + 1);
-        for (int32_t y = 0; y < TILE_MAP_GRID_H; y++)
+        int32_t xx = x * pitchX;
+        for (int32_t y = 0; y < visibleH; y++)
         {
-            int32_t yy = y * (TILE_SIZE_H + 1);
+            int32_t yy = y * pitchY;
 
             const TileData_t& data = getTileData(x, y);
             switch (data.type)
@@ -23,33 +115,33 @@ void TileMap::draw(Painter& painter)
                 case TileType::NONE:
                     painter.filledRect(
                         xx + TILE_MAP_MARGIN_LEFT, yy + TILE_MAP_MARGIN_TOP,
-                        TILE_SIZE_W, TILE_SIZE_H, { 0, 0, 0 });
+                        tileW, tileH, { 0, 0, 0 });
                     break;
                 case TileType::SNAKE_HEAD:
                     painter.filledRect(
                         xx + TILE_MAP_MARGIN_LEFT, yy + TILE_MAP_MARGIN_TOP,
-                        TILE_SIZE_W, TILE_SIZE_H, data.color);
+                        tileW, tileH, getTileColor(data.color));
                     break;
                 case TileType::SNAKE_TAIL:
                 {
-                    Color color = data.color;
+                    Color color = getTileColor(data.color);
                     color.r /= 2;
                     color.g /= 2;
                     color.b /= 2;
                     painter.filledRect(
                         xx + TILE_MAP_MARGIN_LEFT, yy + TILE_MAP_MARGIN_TOP,
-                        TILE_SIZE_W, TILE_SIZE_H, color);
+                        tileW, tileH, color);
                 }
                 break;
                 case TileType::SNAKE_DEAD:
                     painter.filledRect(
                         xx + TILE_MAP_MARGIN_LEFT, yy + TILE_MAP_MARGIN_TOP,
-                        TILE_SIZE_W, TILE_SIZE_H, data.color);
+                        tileW, tileH, getTileColor(data.color));
                     break;
                 case TileType::FOOD:
                     painter.filledEllipse(
                         xx + TILE_MAP_MARGIN_LEFT, yy + TILE_MAP_MARGIN_TOP,
-                        TILE_SIZE_W, TILE_SIZE_H, data.color);
+                        tileW, tileH, getTileColor(data.color));
                     break;
                 default:
                     assert(false);
@@ -58,22 +150,294 @@ void TileMap::draw(Painter& painter)
     }
 }
 
-void TileMap::setData(int32_t x, int32_t y, TileType type, Color color)
+void TileMap::setData(int32_t x, int32_t y, TileType type, uint8_t color)
+{
+    const size_t index = x + (static_cast<size_t>(_width) * y);
+
+    TileData_t& data = _tiles[index];
+
+    const bool wasFree = data.type == TileType::NONE;
+    const bool isFree = type == TileType::NONE;
+    if (wasFree != isFree)
+    {
+        setFree(index, isFree);
+    }
+
+    _hash ^= getTileKey(index, data);
+    data.type = type;
+    data.color = color;
+    _hash ^= getTileKey(index, data);
+}
+
+void TileMap::setChunkData(
+    size_t chunk, int32_t x, int32_t y, TileType type, uint8_t color)
 {
-    TileData_t& data = getTileData(x, y);
+    const size_t index = x + (static_cast<size_t>(_width) * y);
+
+    TileChunk_t& chunkData = _chunks[chunk];
+    if (index / TILE_CHUNK_CELLS != chunk)
+    {
+        chunkData.outbox.push_back(
+            { static_cast<uint32_t>(index), TileData_t{ type, color } });
+        return;
+    }
+
+    TileData_t& data = _tiles[index];
+
+    const bool wasFree = data.type == TileType::NONE;
+    const bool isFree = type == TileType::NONE;
+    if (wasFree != isFree)
+    {
+        const size_t word = index / 64;
+        const uint64_t mask = 1ull << (index % 64);
+
+        uint32_t delta = 1;
+        if (isFree)
+        {
+            _freeBits[word] |= mask;
+        }
+        else
+        {
+            _freeBits[word] &= ~mask;
+            delta = static_cast<uint32_t>(-1);
+        }
+        chunkData.freeDelta += delta;
+
+        // Fenwick nodes up to the chunk size only cover words of this chunk,
+        // the ones above are shared and updated by flushChunks.
+        for (size_t i = word + 1; i < _freeTree.size(); i += i & (0 - i))
+        {
+            if ((i & (0 - i)) > TILE_CHUNK_WORDS)
+                break;
+
+            _freeTree[i] += delta;
+        }
+    }
+
+    chunkData.hashDelta ^= getTileKey(index, data);
     data.type = type;
     data.color = color;
+    chunkData.hashDelta ^= getTileKey(index, data);
+}
+
+void TileMap::flushChunks()
+{
+    for (size_t chunk = 0; chunk < _chunks.size(); chunk++)
+    {
+        TileChunk_t& chunkData = _chunks[chunk];
+
+        _hash ^= chunkData.hashDelta;
+        chunkData.hashDelta = 0;
+
+        if (chunkData.freeDelta == 0)
+            continue;
+
+        const uint32_t delta = chunkData.freeDelta;
+        chunkData.freeDelta = 0;
+        _freeCount += delta;
+
+        // Continue where setChunkData stopped climbing the tree.
+        size_t i = (chunk + 1) * TILE_CHUNK_WORDS;
+        if ((i & (0 - i)) == TILE_CHUNK_WORDS)
+            i += TILE_CHUNK_WORDS;
+
+        for (; i < _freeTree.size(); i += i & (0 - i))
+        {
+            _freeTree[i] += delta;
+        }
+    }
+
+    // Writes across chunk borders, no cell is written by more than one chunk
+    // per update so the order does not matter.
+    for (auto& chunkData : _chunks)
+    {
+        for (const auto& write : chunkData.outbox)
+        {
+            setData(
+                static_cast<int32_t>(write.index % _width),
+                static_cast<int32_t>(write.index / _width), write.data.type,
+                write.data.color);
+        }
+        chunkData.outbox.clear();
+    }
 }
 
 void TileMap::reset()
 {
+    // Free cells must be entirely empty, getRuns skips them.
     for (auto& tileData : _tiles)
     {
-        tileData.type = TileType::NONE;
+        tileData = TileData_t{};
     }
+    rebuildFreeCells();
+    rebuildHash();
 }
 
-std::array<TileData_t, TILE_MAP_SIZE>& TileMap::getData()
+const std::vector<TileData_t>& TileMap::getData() const
 {
     return _tiles;
 }
+
+void TileMap::getRuns(
+    std::vector<uint32_t>& runs, std::vector<TileData_t>& tiles) const
+{
+    runs.clear();
+    tiles.clear();
+
+    // Walks the free cell bits a word at a time, bits past the map end are
+    // never set so the last run stops there.
+    const size_t size = _tiles.size();
+    size_t index = 0;
+    while (index < size)
+    {
+        const size_t word = index / 64;
+        const uint64_t used = ~_freeBits[word] & (~0ull << (index % 64));
+        if (used == 0)
+        {
+            index = (word + 1) * 64;
+            continue;
+        }
+
+        const size_t start = (word * 64) + Utils::selectBit(used, 0);
+        if (start >= size)
+            break;
+
+        index = size;
+        for (size_t next = start / 64; next < _freeBits.size(); next++)
+        {
+            uint64_t free = _freeBits[next];
+            if (next == start / 64)
+                free &= ~0ull << (start % 64);
+            if (free != 0)
+            {
+                index = std::min(
+                    size, (next * 64) + Utils::selectBit(free, 0));
+                break;
+            }
+        }
+
+        runs.push_back(static_cast<uint32_t>(start));
+        runs.push_back(static_cast<uint32_t>(index - start));
+        tiles.insert(
+            tiles.end(), _tiles.begin() + start, _tiles.begin() + index);
+    }
+}
+
+bool TileMap::setRuns(
+    const std::vector<uint32_t>& runs, const std::vector<TileData_t>& tiles)
+{
+    if (runs.size() % 2 != 0)
+        return false;
+
+    size_t count = 0;
+    for (size_t i = 0; i < runs.size(); i += 2)
+    {
+        const size_t end = static_cast<size_t>(runs[i]) + runs[i + 1];
+        if (end > _tiles.size())
+            return false;
+        count += runs[i + 1];
+    }
+    if (count != tiles.size())
+        return false;
+
+    std::fill(_tiles.begin(), _tiles.end(), TileData_t{});
+
+    auto src = tiles.begin();
+    for (size_t i = 0; i < runs.size(); i += 2)
+    {
+        std::copy(src, src + runs[i + 1], _tiles.begin() + runs[i]);
+        src += runs[i + 1];
+    }
+
+    rebuildFreeCells();
+    rebuildHash();
+    return true;
+}
+
+uint32_t TileMap::getFreeCount() const
+{
+    return _freeCount;
+}
+
+Vector2i TileMap::getFreeCell(uint32_t n) const
+{
+    assert(n < _freeCount);
+
+    // Descend the Fenwick tree to find the word holding the n-th free cell.
+    size_t word = 0;
+    const size_t words = _freeBits.size();
+    for (size_t step = _freeTreeStep; step > 0; step >>= 1)
+    {
+        const size_t next = word + step;
+        if (next <= words && _freeTree[next] <= n)
+        {
+            word = next;
+            n -= _freeTree[next];
+        }
+    }
+
+    const size_t index = (word * 64) + Utils::selectBit(_freeBits[word], n);
+
+    return Vector2i{ static_cast<int32_t>(index % _width),
+                     static_cast<int32_t>(index / _width) };
+}
+
+void TileMap::setFree(size_t index, bool free)
+{
+    const size_t word = index / 64;
+    const uint64_t mask = 1ull << (index % 64);
+
+    uint32_t delta = 1;
+    if (free)
+    {
+        _freeBits[word] |= mask;
+        _freeCount++;
+    }
+    else
+    {
+        _freeBits[word] &= ~mask;
+        _freeCount--;
+        delta = static_cast<uint32_t>(-1);
+    }
+
+    for (size_t i = word + 1; i < _freeTree.size(); i += i & (0 - i))
+    {
+        _freeTree[i] += delta;
+    }
+}
+
+void TileMap::rebuildFreeCells()
+{
+    std::fill(_freeBits.begin(), _freeBits.end(), 0);
+    std::fill(_freeTree.begin(), _freeTree.end(), 0);
+    _freeCount = 0;
+
+    for (size_t index = 0; index < _tiles.size(); index++)
+    {
+        if (_tiles[index].type == TileType::NONE)
+        {
+            _freeBits[index / 64] |= 1ull << (index % 64);
+            _freeCount++;
+        }
+    }
+
+    // Linear time Fenwick construction.
+    const size_t words = _freeBits.size();
+    for (size_t i = 1; i <= words; i++)
+    {
+        _freeTree[i] += Utils::popCount(_freeBits[i - 1]);
+
+        const size_t parent = i + (i & (0 - i));
+        if (parent <= words)
+            _freeTree[parent] += _freeTree[i];
+    }
+}
+
+void TileMap::rebuildHash()
+{
+    _hash = 0;
+    for (size_t index = 0; index < _tiles.size(); index++)
+    {
+        _hash ^= getTileKey(index, _tiles[index]);
+    }
+}
\ No newline at end of file
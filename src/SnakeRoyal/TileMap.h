@@ -7,8 +7,10 @@
 #include "Painter.h"
 #include "Color.h"
 #include "Config.h"
+#include "Vector2.h"
+#include "Types.h"
 
-enum class TileType
+enum class TileType : uint8_t
 {
     NONE = 0,
     SNAKE_HEAD,
@@ -17,39 +19,175 @@ enum class TileType
     FOOD,
 };
 
+// Tiles only store an index into the tile palette, player colors follow
+// the fixed entries.
+enum TileColor : uint8_t
+{
+    TILE_COLOR_BG = 0,
+    TILE_COLOR_DEAD,
+    TILE_COLOR_FOOD,
+    TILE_COLOR_PLAYER,
+};
+
 struct TileData_t
 {
     TileType type = TileType::NONE;
-    Color color = COLOR_BLACK;
+    uint8_t color = TILE_COLOR_BG;
 };
 
-static constexpr size_t TILE_MAP_SIZE = TILE_MAP_GRID_H * TILE_MAP_GRID_W;
+static_assert(sizeof(TileData_t) == 2, "TileData_t must stay packed");
+
+inline uint8_t getPlayerTileColor(PlayerId playerId)
+{
+    return static_cast<uint8_t>(
+        TILE_COLOR_PLAYER + (playerId % std::size(COLOR_PLAYER_PALETTE)));
+}
+
+Color getTileColor(uint8_t color);
+
+// The map is split into chunks of consecutive cells that can be written from
+// different threads. A chunk is a whole number of 64 bit words of the free
+// cell index, so no two chunks ever share a word.
+static constexpr size_t TILE_CHUNK_WORDS = 256;
+static constexpr size_t TILE_CHUNK_CELLS = TILE_CHUNK_WORDS * 64;
+
+// Writes into other chunks reserved per chunk up front, only long snakes
+// dying across a chunk border go beyond it.
+static constexpr size_t TILE_CHUNK_OUTBOX = 256;
+
+struct TileWrite_t
+{
+    uint32_t index;
+    TileData_t data;
+};
+
+struct TileChunk_t
+{
+    // Writes into cells of other chunks, applied by flushChunks.
+    std::vector<TileWrite_t> outbox;
+
+    // Free cell change not yet added to the shared part of the index.
+    uint32_t freeDelta = 0;
+
+    // Hash change not yet added to the map hash.
+    uint64_t hashDelta = 0;
+};
 
 class TileMap
 {
 private:
-    std::array<TileData_t, TILE_MAP_SIZE> _tiles;
+    int32_t _width = 0;
+    int32_t _height = 0;
+    std::vector<TileData_t> _tiles;
+
+    // Index of all TileType::NONE cells, one bit per cell and a Fenwick tree
+    // over the per word counts. The n-th free cell only depends on the map
+    // contents and not on the order of writes, clients that joined via
+    // MessageServerState pick the same cells as the server.
+    std::vector<uint64_t> _freeBits;
+    std::vector<uint32_t> _freeTree;
+    size_t _freeTreeStep = 0;
+    uint32_t _freeCount = 0;
+
+    std::vector<TileChunk_t> _chunks;
+
+    // Zobrist hash over all cells, empty cells hash to 0.
+    uint64_t _hash = 0;
 
 public:
+    TileMap();
+
+    // Resizes the map, all tiles are cleared.
+    void init(int32_t width, int32_t height);
+
+    // Takes over the tiles of another map, the per chunk scratch data is
+    // only resized. Does not allocate once both have the same size.
+    void copyState(const TileMap& other);
+
     void draw(Painter& painter);
 
-    TileData_t& getTileData(int32_t x, int32_t y)
+    int32_t getWidth() const
     {
-        const size_t index = x + (TILE_MAP_GRID_W * y);
-        return _tiles[index];
+        return _width;
+    }
+
+    int32_t getHeight() const
+    {
+        return _height;
+    }
+
+    size_t size() const
+    {
+        return _tiles.size();
     }
 
     const TileData_t& getTileData(int32_t x, int32_t y) const
     {
-        const size_t index = x + (TILE_MAP_GRID_W * y);
+        const size_t index = x + (static_cast<size_t>(_width) * y);
+        return _tiles[index];
+    }
+
+    const TileData_t& getTileData(size_t index) const
+    {
         return _tiles[index];
     }
 
-    void setData(int32_t x, int32_t y, TileType type, Color color);
+    // Same as checking for TileType::NONE but only reads the free cell bits.
+    bool isFree(size_t index) const
+    {
+        return ((_freeBits[index / 64] >> (index % 64)) & 1) != 0;
+    }
+
+    void setData(int32_t x, int32_t y, TileType type, uint8_t color);
+
+    size_t getChunkCount() const
+    {
+        return _chunks.size();
+    }
+
+    size_t getChunk(int32_t x, int32_t y) const
+    {
+        const size_t index = x + (static_cast<size_t>(_width) * y);
+        return index / TILE_CHUNK_CELLS;
+    }
+
+    // Same as setData but safe to call from one thread per chunk. Cells
+    // outside of the chunk are queued and only written by flushChunks, which
+    // must be called before the map is used otherwise.
+    void setChunkData(
+        size_t chunk, int32_t x, int32_t y, TileType type, uint8_t color);
+    void flushChunks();
 
     void reset();
 
-    std::array<TileData_t, TILE_MAP_SIZE>& getData();
+    const std::vector<TileData_t>& getData() const;
+
+    // Collects the non empty cells as runs of consecutive cells, runs holds
+    // pairs of first cell and cell count and tiles the cells of all runs.
+    // The size follows what is on the map, not how big the map is.
+    void getRuns(
+        std::vector<uint32_t>& runs, std::vector<TileData_t>& tiles) const;
+
+    // Clears the map and applies runs from getRuns, returns false if they
+    // do not fit the current map size.
+    bool setRuns(
+        const std::vector<uint32_t>& runs,
+        const std::vector<TileData_t>& tiles);
+
+    uint32_t getFreeCount() const;
+
+    // Returns the n-th free cell in map order, n must be below getFreeCount().
+    Vector2i getFreeCell(uint32_t n) const;
+
+    uint64_t getHash() const
+    {
+        return _hash;
+    }
+
+private:
+    void setFree(size_t index, bool free);
+    void rebuildFreeCells();
+    void rebuildHash();
 };
 
 extern TileMap gTileMap;
\ No newline at end of file
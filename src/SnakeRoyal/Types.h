@@ -8,11 +8,11 @@
 #include "Vector2.h"
 #include "Color.h"
 
-using PlayerId = uint8_t;
+using PlayerId = uint16_t;
 
 static constexpr PlayerId INVALID_PLAYER_ID = std::numeric_limits<
     PlayerId>::max();
 
-using SnakeId = uint8_t;
+using SnakeId = uint16_t;
 
 static constexpr SnakeId INVALID_SNAKE_ID = std::numeric_limits<SnakeId>::max();
\ No newline at end of file
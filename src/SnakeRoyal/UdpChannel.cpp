@@ -0,0 +1,439 @@
+#include "UdpChannel.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+
+// Bytes of a packet left for unreliable messages and the reliable fragment.
+static constexpr size_t MAX_PAYLOAD = NETWORK_UDP_PACKET_SIZE
+                                      - sizeof(UdpPacketHeader_t);
+
+// Acknowledged stream bytes are dropped once there are this many, the rest
+// is moved down each time.
+static constexpr uint64_t SEND_TRIM_SIZE = 1024 * 4;
+
+static bool sequenceNewer(uint32_t a, uint32_t b)
+{
+    return static_cast<int32_t>(a - b) > 0;
+}
+
+UdpChannel::UdpChannel(const SocketAddress_t& address, double now)
+    : _address(address)
+    , _hostName(GetSocketAddressName(address))
+    , _lastSendTime(now)
+    , _lastReceiveTime(now)
+{
+}
+
+bool UdpChannel::isPacket(const uint8_t* data, size_t size)
+{
+    if (size < sizeof(UdpPacketHeader_t))
+        return false;
+
+    uint32_t signature;
+    memcpy(&signature, data, sizeof(signature));
+    return signature == NETWORK_UDP_SIGNATURE;
+}
+
+bool UdpChannel::readConnect(
+    const uint8_t* data, size_t size, uint64_t& cookie,
+    const uint8_t*& message, size_t& messageSize)
+{
+    UdpHandshake_t handshake;
+    if (size < sizeof(handshake))
+        return false;
+
+    memcpy(&handshake, data, sizeof(handshake));
+    if (handshake.signature != NETWORK_UDP_CONNECT_SIGNATURE)
+        return false;
+
+    cookie = handshake.cookie;
+    message = data + sizeof(handshake);
+    messageSize = size - sizeof(handshake);
+    return true;
+}
+
+void UdpChannel::connect(const void* message, size_t size, double now)
+{
+    UdpHandshake_t handshake{};
+    handshake.signature = NETWORK_UDP_CONNECT_SIGNATURE;
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(message);
+    _connectData.resize(sizeof(handshake));
+    memcpy(_connectData.data(), &handshake, sizeof(handshake));
+    _connectData.insert(_connectData.end(), bytes, bytes + size);
+
+    _connectTime = now - NETWORK_UDP_CONNECT_RESEND;
+}
+
+void UdpChannel::write(const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    _sendData.insert(_sendData.end(), bytes, bytes + size);
+}
+
+bool UdpChannel::writeUnreliable(const void* data, size_t size)
+{
+    if (_messages.size() + size > MAX_PAYLOAD)
+        return false;
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    _messages.insert(_messages.end(), bytes, bytes + size);
+    return true;
+}
+
+void UdpChannel::writePackets(
+    double now, std::vector<SocketDatagram_t>& datagrams)
+{
+    if (!_connectData.empty())
+    {
+        if (now - _connectTime >= NETWORK_UDP_CONNECT_RESEND)
+        {
+            datagrams.push_back(SocketDatagram_t{
+                _address, _connectData.data(), _connectData.size() });
+            _connectTime = now;
+        }
+        return;
+    }
+
+    detectLosses(now);
+
+    _packetData.clear();
+
+    const size_t first = datagrams.size();
+    const uint64_t streamEnd = _sendBase + _sendData.size();
+
+    // Lost bytes go first, the peer can not read past them anyway.
+    size_t packets = 0;
+    while (!_resends.empty() && packets < NETWORK_UDP_BURST)
+    {
+        StreamRange_t& range = _resends.front();
+        range.start = std::max(range.start, _remoteStreamAck);
+        if (range.start >= range.end)
+        {
+            _resends.pop_front();
+            continue;
+        }
+
+        const size_t size = static_cast<size_t>(std::min<uint64_t>(
+            range.end - range.start, MAX_PAYLOAD - _messages.size()));
+        writePacket(now, range.start, size, datagrams);
+        range.start += size;
+        packets++;
+    }
+
+    while (_sendNext < streamEnd && packets < NETWORK_UDP_BURST
+           && _sendNext - _remoteStreamAck < NETWORK_UDP_WINDOW)
+    {
+        // Repeats what is still unacknowledged if that is little, it
+        // arrives with this packet if the previous one got lost.
+        uint64_t start = _sendNext;
+        if (packets == 0
+            && _sendNext - _remoteStreamAck <= NETWORK_UDP_REDUNDANT)
+        {
+            start = _remoteStreamAck;
+        }
+
+        const size_t size = static_cast<size_t>(std::min<uint64_t>(
+            streamEnd - start, MAX_PAYLOAD - _messages.size()));
+        writePacket(now, start, size, datagrams);
+        _sendNext = std::max(_sendNext, start + size);
+        packets++;
+    }
+
+    if (packets == 0
+        && (!_messages.empty()
+            || (_ackOwed && now - _ackTime >= NETWORK_UDP_ACK_DELAY)
+            || now - _lastSendTime >= NETWORK_UDP_KEEPALIVE))
+    {
+        writePacket(now, _sendNext, 0, datagrams);
+    }
+
+    // Only now the packet data stays where it is.
+    uint8_t* data = _packetData.data();
+    for (size_t i = first; i < datagrams.size(); i++)
+    {
+        datagrams[i].data = data;
+        data += datagrams[i].size;
+    }
+}
+
+void UdpChannel::writePacket(
+    double now, uint64_t streamOffset, size_t streamSize,
+    std::vector<SocketDatagram_t>& datagrams)
+{
+    UdpPacketHeader_t header{};
+    header.signature = NETWORK_UDP_SIGNATURE;
+    header.sequence = _nextSequence;
+    header.ack = _remoteSequence;
+    header.ackBits = _receivedBits;
+    header.streamAck = _recvStreamEnd;
+    header.streamOffset = streamOffset;
+    header.streamSize = static_cast<uint16_t>(streamSize);
+    header.messageSize = static_cast<uint16_t>(_messages.size());
+
+    // 0 is never used, an ack of 0 means nothing was received yet.
+    _nextSequence++;
+    if (_nextSequence == 0)
+        _nextSequence = 1;
+
+    const size_t size = sizeof(header) + _messages.size() + streamSize;
+    const size_t start = _packetData.size();
+    _packetData.resize(start + size);
+
+    uint8_t* packet = _packetData.data() + start;
+    memcpy(packet, &header, sizeof(header));
+    packet += sizeof(header);
+
+    if (!_messages.empty())
+    {
+        memcpy(packet, _messages.data(), _messages.size());
+        packet += _messages.size();
+        _messages.clear();
+    }
+
+    if (streamSize > 0)
+    {
+        memcpy(
+            packet, _sendData.data() + (streamOffset - _sendBase),
+            streamSize);
+
+        _sentPackets.push_back(
+            SentPacket_t{ header.sequence, now, streamOffset, streamSize });
+    }
+
+    // The data is filled in by writePackets.
+    datagrams.push_back(SocketDatagram_t{ _address, nullptr, size });
+
+    _ackOwed = false;
+    _lastSendTime = now;
+}
+
+bool UdpChannel::processPacket(const uint8_t* data, size_t size, double now)
+{
+    // The connect goes out again right away with the cookie.
+    UdpHandshake_t challenge;
+    if (!_connectData.empty() && size == sizeof(challenge))
+    {
+        memcpy(&challenge, data, sizeof(challenge));
+        if (challenge.signature == NETWORK_UDP_CHALLENGE_SIGNATURE)
+        {
+            memcpy(
+                _connectData.data() + offsetof(UdpHandshake_t, cookie),
+                &challenge.cookie, sizeof(challenge.cookie));
+            _connectTime = now - NETWORK_UDP_CONNECT_RESEND;
+            return true;
+        }
+    }
+
+    if (!isPacket(data, size))
+        return false;
+
+    UdpPacketHeader_t header;
+    memcpy(&header, data, sizeof(header));
+
+    if (header.sequence == 0
+        || sizeof(header) + header.messageSize + header.streamSize != size
+        || header.streamOffset > UINT64_MAX - header.streamSize)
+    {
+        return false;
+    }
+
+    // Duplicates are dropped, the bits can only tell for the last 33.
+    if (!_hasReceived || sequenceNewer(header.sequence, _remoteSequence))
+    {
+        const uint32_t shift = _hasReceived
+                                   ? header.sequence - _remoteSequence
+                                   : 33;
+        if (shift > 32)
+            _receivedBits = 0;
+        else
+        {
+            _receivedBits = shift == 32 ? 0 : _receivedBits << shift;
+            _receivedBits |= 1u << (shift - 1);
+        }
+        _remoteSequence = header.sequence;
+        _hasReceived = true;
+    }
+    else
+    {
+        const uint32_t age = _remoteSequence - header.sequence;
+        if (age == 0)
+            return true;
+
+        if (age <= 32)
+        {
+            const uint32_t bit = 1u << (age - 1);
+            if ((_receivedBits & bit) != 0)
+                return true;
+            _receivedBits |= bit;
+        }
+    }
+
+    // The server took the connect.
+    _connectData.clear();
+
+    _lastReceiveTime = now;
+    processAcks(header, now);
+
+    const uint8_t* payload = data + sizeof(header);
+    if (header.messageSize > 0)
+    {
+        _receivedMessages.insert(
+            _receivedMessages.end(), payload, payload + header.messageSize);
+    }
+    if (header.streamSize > 0)
+    {
+        receiveStream(
+            header.streamOffset, payload + header.messageSize,
+            header.streamSize);
+    }
+
+    // Packets that only acknowledge are not acknowledged themselves.
+    if ((header.messageSize > 0 || header.streamSize > 0) && !_ackOwed)
+    {
+        _ackOwed = true;
+        _ackTime = now;
+    }
+    return true;
+}
+
+void UdpChannel::processAcks(const UdpPacketHeader_t& header, double now)
+{
+    // Can not be beyond what was sent unless the peer is broken.
+    if (header.streamAck > _remoteStreamAck && header.streamAck <= _sendNext)
+    {
+        _remoteStreamAck = header.streamAck;
+
+        const uint64_t acked = _remoteStreamAck - _sendBase;
+        if (acked == _sendData.size()
+            || (acked >= SEND_TRIM_SIZE && acked * 2 >= _sendData.size()))
+        {
+            _sendData.erase(
+                _sendData.begin(),
+                _sendData.begin() + static_cast<size_t>(acked));
+            _sendBase = _remoteStreamAck;
+        }
+    }
+
+    if (header.ack == 0)
+        return;
+
+    if (!_hasAck || sequenceNewer(header.ack, _newestAck))
+    {
+        _newestAck = header.ack;
+        _hasAck = true;
+    }
+
+    for (auto it = _sentPackets.begin(); it != _sentPackets.end();)
+    {
+        const uint32_t age = header.ack - it->sequence;
+        const bool acked = age == 0
+                           || (age <= 32
+                               && (header.ackBits & (1u << (age - 1))) != 0);
+        if (!acked)
+        {
+            it++;
+            continue;
+        }
+
+        // Smoothed the same way as TCP does.
+        _roundTrip += (now - it->time - _roundTrip) * 0.125;
+        it = _sentPackets.erase(it);
+    }
+}
+
+void UdpChannel::detectLosses(double now)
+{
+    const double timeout = std::max(NETWORK_UDP_MIN_RESEND, _roundTrip * 2.0);
+
+    for (auto it = _sentPackets.begin(); it != _sentPackets.end();)
+    {
+        const SentPacket_t& sent = *it;
+
+        // Arrived with a later packet already.
+        const bool received = sent.streamOffset + sent.streamSize
+                              <= _remoteStreamAck;
+        const bool overtaken = _hasAck
+                               && static_cast<int32_t>(
+                                      _newestAck - sent.sequence)
+                                      >= static_cast<int32_t>(
+                                          NETWORK_UDP_REORDER);
+        const bool expired = now - sent.time > timeout;
+
+        if (!received && !overtaken && !expired)
+        {
+            it++;
+            continue;
+        }
+
+        if (!received)
+        {
+            _resends.push_back(StreamRange_t{
+                sent.streamOffset, sent.streamOffset + sent.streamSize });
+        }
+        it = _sentPackets.erase(it);
+    }
+}
+
+void UdpChannel::receiveStream(
+    uint64_t offset, const uint8_t* data, size_t size)
+{
+    const uint64_t end = offset + size;
+    if (end <= _recvStreamEnd)
+        return;
+
+    if (offset > _recvStreamEnd)
+    {
+        // The peer never sends that far ahead of what we acknowledged.
+        if (end - _recvStreamEnd > NETWORK_UDP_WINDOW + MAX_PAYLOAD)
+            return;
+
+        auto& pending = _pending[offset];
+        if (pending.size() < size)
+            pending.assign(data, data + size);
+        return;
+    }
+
+    appendStream(
+        data + (_recvStreamEnd - offset),
+        static_cast<size_t>(end - _recvStreamEnd));
+
+    // Whatever waited for this follows now.
+    while (!_pending.empty() && _pending.begin()->first <= _recvStreamEnd)
+    {
+        auto it = _pending.begin();
+
+        const uint64_t pendingEnd = it->first + it->second.size();
+        if (pendingEnd > _recvStreamEnd)
+        {
+            appendStream(
+                it->second.data() + (_recvStreamEnd - it->first),
+                static_cast<size_t>(pendingEnd - _recvStreamEnd));
+        }
+        _pending.erase(it);
+    }
+}
+
+void UdpChannel::appendStream(const uint8_t* data, size_t size)
+{
+    _recvData.insert(_recvData.end(), data, data + size);
+    _recvStreamEnd += size;
+}
+
+size_t UdpChannel::read(void* data, size_t size)
+{
+    const size_t count = std::min(size, _recvData.size() - _recvRead);
+    if (count > 0)
+    {
+        memcpy(data, _recvData.data() + _recvRead, count);
+        _recvRead += count;
+    }
+
+    if (_recvRead == _recvData.size())
+    {
+        _recvData.clear();
+        _recvRead = 0;
+    }
+    return count;
+}
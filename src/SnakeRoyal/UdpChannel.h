@@ -0,0 +1,234 @@
+#pragma once
+
+#include "Socket.h"
+
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+static constexpr uint32_t NETWORK_UDP_SIGNATURE = 0xDEADF00D;
+static constexpr uint32_t NETWORK_UDP_CONNECT_SIGNATURE = 0xDEADC0DE;
+static constexpr uint32_t NETWORK_UDP_CHALLENGE_SIGNATURE = 0xDEADBEEF;
+
+// Largest datagram sent, stays below the usual path MTU.
+static constexpr size_t NETWORK_UDP_PACKET_SIZE = 1200;
+
+// Reliable bytes sent but not acknowledged yet, more waits.
+static constexpr uint64_t NETWORK_UDP_WINDOW = 1024 * 256;
+
+// Packets written per flush at most, the rest goes with the next ones.
+static constexpr size_t NETWORK_UDP_BURST = 64;
+
+// Reliable bytes not acknowledged yet are sent again with new ones while
+// they are at most this many, a single lost packet then costs nothing.
+static constexpr uint64_t NETWORK_UDP_REDUNDANT = 512;
+
+// A packet is lost once this many later ones were acknowledged.
+static constexpr uint32_t NETWORK_UDP_REORDER = 3;
+
+// Lower bound of the resend timeout in seconds, it is twice the round trip
+// time otherwise.
+static constexpr double NETWORK_UDP_MIN_RESEND = 0.02;
+
+// Acknowledgements wait this long for something to go with, in seconds.
+static constexpr double NETWORK_UDP_ACK_DELAY = 0.01;
+
+// Something is sent at least this often, and a peer that stays silent for
+// the timeout is gone. Both in seconds.
+static constexpr double NETWORK_UDP_KEEPALIVE = 0.5;
+static constexpr double NETWORK_UDP_TIMEOUT = 5.0;
+
+// Connect packets are sent this often until the peer answers, in seconds.
+static constexpr double NETWORK_UDP_CONNECT_RESEND = 0.25;
+
+// Sent by a client to open a channel, its first message follows. Without
+// the cookie of a challenge the server answers with one instead, only a
+// client that receives at the address it sends from gets that far. The
+// server keeps nothing before, and answers with less than it was sent so
+// it can not be used to flood someone else.
+struct UdpHandshake_t
+{
+    uint32_t signature;
+    uint32_t reserved;
+    uint64_t cookie;
+};
+
+// Sent in front of every datagram. The unreliable messages follow, then the
+// reliable fragment.
+struct UdpPacketHeader_t
+{
+    uint32_t signature;
+    uint32_t sequence;
+
+    // Newest sequence received, bit n of ackBits is the one n + 1 before.
+    uint32_t ack;
+    uint32_t ackBits;
+
+    // Reliable bytes received in order.
+    uint64_t streamAck;
+
+    // Where in the reliable stream the fragment starts.
+    uint64_t streamOffset;
+    uint16_t streamSize;
+    uint16_t messageSize;
+};
+
+// A reliable ordered byte stream plus unreliable messages to one peer over
+// datagrams, it only builds and reads packets, the socket belongs to the
+// caller. Every packet acknowledges the last 33 received, the reliable
+// bytes of packets that went unacknowledged are sent again.
+class UdpChannel
+{
+    struct SentPacket_t
+    {
+        uint32_t sequence;
+        double time;
+        uint64_t streamOffset;
+        uint64_t streamSize;
+    };
+
+    struct StreamRange_t
+    {
+        uint64_t start;
+        uint64_t end;
+    };
+
+    SocketAddress_t _address;
+    std::string _hostName;
+    bool _closed = false;
+
+private: // Sending.
+    // Stream bytes from _sendBase on, everything before was acknowledged.
+    std::vector<uint8_t> _sendData;
+    uint64_t _sendBase = 0;
+
+    // End of what was sent at least once.
+    uint64_t _sendNext = 0;
+
+    // Received in order by the peer.
+    uint64_t _remoteStreamAck = 0;
+
+    // Oldest first, only packets with reliable bytes are kept.
+    std::deque<SentPacket_t> _sentPackets;
+    std::deque<StreamRange_t> _resends;
+
+    std::vector<uint8_t> _messages;
+
+    uint32_t _nextSequence = 1;
+    uint32_t _newestAck = 0;
+    bool _hasAck = false;
+
+    double _lastSendTime = 0.0;
+    double _roundTrip = 0.1;
+
+    // Packets written by writePackets, sent by the caller.
+    std::vector<uint8_t> _packetData;
+
+    // The connect packet, sent instead of everything else until the first
+    // packet of the peer arrived. Empty once it did.
+    std::vector<uint8_t> _connectData;
+    double _connectTime = 0.0;
+
+private: // Receiving.
+    uint32_t _remoteSequence = 0;
+    uint32_t _receivedBits = 0;
+    bool _hasReceived = false;
+
+    // Something arrived that needs an acknowledgement.
+    bool _ackOwed = false;
+    double _ackTime = 0.0;
+    double _lastReceiveTime = 0.0;
+
+    // Stream bytes received in order but not read yet.
+    std::vector<uint8_t> _recvData;
+    size_t _recvRead = 0;
+    uint64_t _recvStreamEnd = 0;
+
+    // Fragments that arrived ahead of a missing one, by stream offset.
+    std::map<uint64_t, std::vector<uint8_t>> _pending;
+
+    std::vector<uint8_t> _receivedMessages;
+
+public:
+    // The address is left empty for a connected socket.
+    UdpChannel(const SocketAddress_t& address, double now);
+
+    // Does the datagram look like one of ours at all.
+    static bool isPacket(const uint8_t* data, size_t size);
+
+    // Reads a connect packet, the message is the rest of the datagram.
+    // False if the datagram is none.
+    static bool readConnect(
+        const uint8_t* data, size_t size, uint64_t& cookie,
+        const uint8_t*& message, size_t& messageSize);
+
+    const SocketAddress_t& getAddress() const
+    {
+        return _address;
+    }
+
+    const char* getHostName() const
+    {
+        return _hostName.c_str();
+    }
+
+    // Closed by us or the peer went silent.
+    bool isClosed(double now) const
+    {
+        return _closed || now - _lastReceiveTime > NETWORK_UDP_TIMEOUT;
+    }
+
+    void close()
+    {
+        _closed = true;
+    }
+
+    // Bytes written that were not sent even once yet.
+    size_t getBacklog() const
+    {
+        return static_cast<size_t>(_sendBase + _sendData.size() - _sendNext);
+    }
+
+    // Opens the channel to a server with the message, see UdpHandshake_t.
+    // Nothing else is sent before the server answered.
+    void connect(const void* message, size_t size, double now);
+
+    bool isConnecting() const
+    {
+        return !_connectData.empty();
+    }
+
+    // Appends to the reliable stream.
+    void write(const void* data, size_t size);
+
+    // Goes with the next packet only, dropped if it does not fit into one.
+    bool writeUnreliable(const void* data, size_t size);
+
+    // Appends the packets due now, they point into the channel and stay
+    // valid until the next call.
+    void writePackets(double now, std::vector<SocketDatagram_t>& datagrams);
+
+    // Takes a datagram from the peer, false if it is malformed.
+    bool processPacket(const uint8_t* data, size_t size, double now);
+
+    // Reads stream bytes received in order, returns how many.
+    size_t read(void* data, size_t size);
+
+    // Unreliable messages as received, the caller clears them once they
+    // were handled.
+    std::vector<uint8_t>& getReceivedMessages()
+    {
+        return _receivedMessages;
+    }
+
+private:
+    void processAcks(const UdpPacketHeader_t& header, double now);
+    void detectLosses(double now);
+    void writePacket(
+        double now, uint64_t streamOffset, size_t streamSize,
+        std::vector<SocketDatagram_t>& datagrams);
+    void receiveStream(uint64_t offset, const uint8_t* data, size_t size);
+    void appendStream(const uint8_t* data, size_t size);
+};
@@ -1,5 +1,7 @@
-#include <windows.h>
+#include "Platform.h"
 #include <chrono>
+#include <stdlib.h>
+#include <string.h>
 #include "Utils.h"
 
 namespace Utils
@@ -15,6 +17,72 @@ double getTime()
            / 1000000000.0;
 }
 
+static inline uint64_t rotl(uint64_t x, int bits)
+{
+    return (x << bits) | (x >> (64 - bits));
+}
+
+static inline void sipRound(uint64_t (&v)[4])
+{
+    v[0] += v[1];
+    v[1] = rotl(v[1], 13);
+    v[1] ^= v[0];
+    v[0] = rotl(v[0], 32);
+    v[2] += v[3];
+    v[3] = rotl(v[3], 16);
+    v[3] ^= v[2];
+    v[0] += v[3];
+    v[3] = rotl(v[3], 21);
+    v[3] ^= v[0];
+    v[2] += v[1];
+    v[1] = rotl(v[1], 17);
+    v[1] ^= v[2];
+    v[2] = rotl(v[2], 32);
+}
+
+uint64_t sipHash(const uint64_t (&key)[2], const void* data, size_t size)
+{
+    uint64_t v[4] = {
+        key[0] ^ 0x736F6D6570736575ull,
+        key[1] ^ 0x646F72616E646F6Dull,
+        key[0] ^ 0x6C7967656E657261ull,
+        key[1] ^ 0x7465646279746573ull,
+    };
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    const size_t words = size / 8;
+    for (size_t i = 0; i < words; i++)
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i * 8, sizeof(word));
+
+        v[3] ^= word;
+        sipRound(v);
+        sipRound(v);
+        v[0] ^= word;
+    }
+
+    // The remaining bytes and the size go into the last word.
+    uint64_t last = static_cast<uint64_t>(size) << 56;
+    for (size_t i = words * 8; i < size; i++)
+    {
+        last |= static_cast<uint64_t>(bytes[i]) << ((i % 8) * 8);
+    }
+
+    v[3] ^= last;
+    sipRound(v);
+    sipRound(v);
+    v[0] ^= last;
+
+    v[2] ^= 0xFF;
+    for (int i = 0; i < 4; i++)
+    {
+        sipRound(v);
+    }
+    return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
+
+#ifdef _WIN32
 std::wstring toWString(const std::string& str)
 {
     int num_chars = MultiByteToWideChar(
@@ -51,5 +119,26 @@ void getUsername(char* buffer, size_t maxBuffer)
     DWORD bufferSize = maxBuffer;
     GetUserNameA(buffer, &bufferSize);
 }
+#else
+// Only used on Windows for the command line, plain ASCII is enough here.
+std::wstring toWString(const std::string& str)
+{
+    return std::wstring(str.begin(), str.end());
+}
+
+std::string toMBString(const std::wstring& wstr)
+{
+    return std::string(wstr.begin(), wstr.end());
+}
+
+void getUsername(char* buffer, size_t maxBuffer)
+{
+    memset(buffer, 0, maxBuffer);
+
+    const char* user = getenv("USER");
+    if (user != nullptr)
+        snprintf(buffer, maxBuffer, "%s", user);
+}
+#endif
 
 } // namespace Utils
\ No newline at end of file
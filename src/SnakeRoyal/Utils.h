@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <stdint.h>
 
 namespace Utils
 {
@@ -14,6 +15,42 @@ template<typename T> int mod(T x, T divisor)
     return m + ((m >> ((sizeof(T) * 8) - 1)) & divisor);
 }
 
+// Number of set bits.
+inline uint32_t popCount(uint64_t x)
+{
+    x = x - ((x >> 1) & 0x5555555555555555ull);
+    x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    return static_cast<uint32_t>((x * 0x0101010101010101ull) >> 56);
+}
+
+// Bit position of the n-th (0 based) set bit, x must have more than n bits.
+inline uint32_t selectBit(uint64_t x, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++)
+    {
+        x &= x - 1;
+    }
+    return popCount((x & (0 - x)) - 1);
+}
+
+// Mixes all bits of x (splitmix64 finalizer), used to derive Zobrist keys on
+// the fly instead of keeping key tables around.
+inline uint64_t hash64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+// Keyed hash (SipHash-2-4) of the bytes, nobody without the key can tell
+// the hash of other bytes from the ones seen. Words are read in host byte
+// order, the hashes are only ever compared on the same machine.
+uint64_t sipHash(const uint64_t (&key)[2], const void* data, size_t size);
+
 void getUsername(char* buffer, size_t maxBuffer);
 
 } // namespace Utils